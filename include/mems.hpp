@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
 
 namespace mems {
 	// Linear allocator used to group together allocations
@@ -9,7 +10,25 @@ namespace mems {
 	// https://www.rfleury.com/p/untangling-lifetimes-the-arena-allocator
 	struct Arena {
 #define push_struct(ptr, struc) push_data(ptr, sizeof(struc))
-		void alloc(uint64_t cap = 1000LL * 1000LL * 1000LL / 4LL);
+		static constexpr uint64_t DEFAULT_CAPACITY = 1000LL * 1000LL * 1000LL / 4LL;
+
+		enum Flags : uint32_t {
+			NONE = 0,
+
+			// A chained arena reserves another block of (at least) cap bytes whenever the current one runs out,
+			// instead of aborting. Every push is still contiguous, but two pushes that straddle a block boundary
+			// won't be next to each other, so don't rely on peek() to build arrays in a chained arena
+			CHAINED = 1 << 0,
+
+			// Asks the OS to back the arena with huge pages, which cuts down on TLB misses and page faults for
+			// big buffers that get walked linearly. Memory is then committed a whole huge page at a time, so only
+			// use this for arenas that actually grow to several megabytes. Quietly falls back to normal pages
+			// when huge pages aren't available (see ArenaStats::hugePages)
+			HUGE_PAGES = 1 << 1,
+		};
+
+		// name is only used by the memory report, so it should be a string literal
+		void alloc(uint64_t cap = DEFAULT_CAPACITY, const char* name = "unnamed", uint32_t flags = NONE);
 		void dealloc();
 
 		void clear();
@@ -18,12 +37,45 @@ namespace mems {
 		void* push(size_t len);
 		void* push_data(const void* pData, size_t sizeData);
 		void* push_zero(size_t len);
+		// align has to be a power of 2, use these for anything that isn't a byte array
+		void* push_aligned(size_t len, size_t align);
+		void* push_zero_aligned(size_t len, size_t align);
 		void pop(size_t len);
 		void pop_to(size_t newPos);
 
+		// position across all blocks, this is what ArenaScope and pop_to work with
+		size_t get_pos() const { return basePos + pos - blockStart; }
+
+		// these describe the current block, which is the only block for an unchained arena
 		void* data;
 		size_t pos;
 		size_t capacity;
+
+		// high-water mark of committed bytes, always page-aligned
+		// push only asks the OS for more memory once pos moves past this
+		size_t committed;
+
+		uint32_t flags;
+		bool hugePages;    // whether the OS actually accepted HUGE_PAGES for the current block
+
+		// chaining, every block after the first starts with a header that describes the block before it
+		int nBlocks;
+		size_t blockCapacity;    // minimum reservation for each new block
+		size_t basePos;          // get_pos() of the first byte after the current block's header
+		size_t blockStart;       // 0 for the first block, otherwise the size of the block header
+
+		// telemetry, these are reported by mems::print_report
+		const char* name;
+		size_t peakPos;
+		uint64_t nPushes, nPops;
+		uint64_t nCommits;    // times the arena called into the OS to commit or decommit, after alloc's first page
+		int scopeDepth, peakScopeDepth;
+
+	private:
+		void _commit_to(size_t newPos);
+		void* _reserve_block(size_t& cap);
+		void _push_block(size_t len);
+		void _pop_block();
 	};
 
 	// Helper struct meant to automatically handle temporary allocations
@@ -37,25 +89,113 @@ namespace mems {
 		Arena& arena;
 	};
 
+	// copies a whole file into the arena, returns nullptr if the file couldn't be read
 	void* load_file(Arena&, const char*, size_t&);
 
+	// printf into a null-terminated string allocated from the arena
+	char* push_printf(Arena&, const char* fmt, ...);
+
+	// Read-only view of a whole file, mapped straight from the OS page cache
+	// Unlike load_file, nothing gets copied, so decoders should read from data directly.
+	// The pages are hinted as sequential and prefetched, since loaders read assets front to back
+	struct MappedFile {
+		const void* data = nullptr;
+		size_t size = 0;
+
+		// number of readable (zeroed) bytes past size before the end of the last page
+		// some parsers (simdjson) need padding past the end of their input, which this can provide for free
+		size_t slack = 0;
+
+#if defined(_WIN32)
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+
+	bool map_file(MappedFile& file, const char* path);
+	void unmap_file(MappedFile& file);
+
 	void init();
 	void close();
-	Arena& get_scratch();
+
+	// Each thread owns NUM_SCRATCH scratch arenas, which are reserved the first time that thread asks for one.
+	// Pass in any arenas the caller is already holding (e.g. an output arena that might itself be a scratch arena)
+	// and get_scratch will never hand one of them back:
+	//
+	//	void bingus(Arena& out) {
+	//		Arena& scratch = mems::get_scratch(out);
+	//		ArenaScope scope(scratch);
+	//		...
+	//	}
+	static constexpr int NUM_SCRATCH = 2;
+	Arena& get_scratch_excluding(const Arena* const* conflicts, int nConflicts);
+
+	template<typename... Conflicts>
+	inline Arena& get_scratch(const Conflicts&... conflicts) {
+		const Arena* list[] = { &conflicts..., nullptr };
+		return get_scratch_excluding(list, static_cast<int>(sizeof...(Conflicts)));
+	}
+
+	// Releases the calling thread's scratch arenas. Worker threads don't need to call this,
+	// it happens automatically when they exit, but it can be used to give the memory back early
+	void release_thread_scratch();
+
+	// Snapshot of an arena's usage. Arenas that were already deallocated keep their final numbers
+	struct ArenaStats {
+		const char* name;
+		size_t capacity;
+		size_t committed;
+		size_t pos, peakPos;
+		uint64_t nPushes, nPops;
+		uint64_t nCommits;
+		int scopeDepth, peakScopeDepth;
+		int nBlocks;
+		uint32_t flags;
+		bool hugePages;
+		bool live;
+	};
+
+	// Memory that doesn't live in an arena (e.g. GPU textures) but that we still want in the report
+	// Setting bytes to 0 marks the allocation as released
+	struct ExternalStats {
+		const char* name;
+		uint64_t bytes, peakBytes;
+	};
+
+	static constexpr int MAX_TRACKED = 64;
+	int get_arena_stats(ArenaStats* out, int maxStats);
+	int get_external_stats(ExternalStats* out, int maxStats);
+	void track_external(const char* name, uint64_t bytes);
+	void print_report(FILE* fp = stdout);
+
+	// HUGE_PAGES is only a request, clearing this makes every arena allocated afterwards use normal pages
+	// so the same work can be timed both ways (see game_bench_load)
+	extern bool allowHugePages;
+	// page faults the whole process has taken so far, soft ones included
+	uint64_t get_page_faults();
 }
 
 #ifdef MEMS_IMPLEMENTATION
 
 #include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <atomic>
 
 #if defined(_WIN32)
 #define MEMS_WIN
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
 #elif defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
 #define MEMS_UNIX
-#error mems.cpp not implemented for Unix-type systems!
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #else
 #error mems.cpp not implemented for this platform!
 #endif
@@ -71,10 +211,20 @@ namespace mems {
 	uint64_t pageSize = 4096;
 	uint64_t round_to_page_size(uint64_t size) {
 		uint64_t rem = size % pageSize;
-		size -= rem;
-		return size + pageSize;
+		if (rem == 0) return size;
+		return size - rem + pageSize;
 	}
 
+	// Arenas commit memory in chunks of this size, so that a run of small pushes
+	// only reaches the OS once every commitGranularity bytes instead of on every push
+	uint64_t commitGranularity = 64 * 1024;
+
+	bool allowHugePages = true;
+
+	// huge page arenas are reserved, aligned and committed in steps of this size
+	// 2MB is the huge page size on x64 and most aarch64 configurations
+	constexpr uint64_t hugePageSize = 2 * 1024 * 1024;
+
 #if defined(MEMS_WIN)
 	inline uint64_t get_page_size() {
 		SYSTEM_INFO si = { 0 };
@@ -87,11 +237,24 @@ namespace mems {
 		return VirtualAlloc(nullptr, cap, MEM_RESERVE, PAGE_READWRITE);
 	}
 
+	// MEM_LARGE_PAGES needs SeLockMemoryPrivilege and has to be committed all at once,
+	// which doesn't fit reserve-then-commit arenas, so windows always falls back to normal pages
+	inline void* _reserve_huge(size_t cap, bool& gotHugePages) {
+		gotHugePages = false;
+		return _reserve(cap);
+	}
+
+	uint64_t get_page_faults() {
+		PROCESS_MEMORY_COUNTERS counters = {};
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.PageFaultCount;
+	}
+
 	inline void* _commit(void* start, size_t size) {
 		return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE);
 	}
 
-	inline bool _release(void* region) {
+	inline bool _release(void* region, size_t cap) {
 		return VirtualFree(region, 0, MEM_RELEASE);
 	}
 
@@ -100,25 +263,132 @@ namespace mems {
 		return VirtualFree(region, size, MEM_DECOMMIT);
 	}
 
+	bool map_file(MappedFile& file, const char* path) {
+		file = {};
+		HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER fileSize = { 0 };
+		if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(fileHandle);
+			return false;
+		}
+
+		HANDLE mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mappingHandle) {
+			CloseHandle(fileHandle);
+			return false;
+		}
+
+		void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if (!view) {
+			CloseHandle(mappingHandle);
+			CloseHandle(fileHandle);
+			return false;
+		}
+
+		WIN32_MEMORY_RANGE_ENTRY range = { view, static_cast<SIZE_T>(fileSize.QuadPart) };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+
+		file.data = view;
+		file.size = static_cast<size_t>(fileSize.QuadPart);
+		file.slack = round_to_page_size(file.size) - file.size;
+		file.fileHandle = fileHandle;
+		file.mappingHandle = mappingHandle;
+		return true;
+	}
+
+	void unmap_file(MappedFile& file) {
+		if (file.data) UnmapViewOfFile(file.data);
+		if (file.mappingHandle) CloseHandle(file.mappingHandle);
+		if (file.fileHandle) CloseHandle(file.fileHandle);
+		file = {};
+	}
+
 #elif defined(MEMS_UNIX)
 	inline uint64_t get_page_size() {
-		return 4096;
+		long size = sysconf(_SC_PAGESIZE);
+		return size > 0 ? static_cast<uint64_t>(size) : 4096;
 	}
 
+	// reserved pages are PROT_NONE, so touching memory that was never committed faults just like on windows
 	inline void* _reserve(size_t cap) {
-		return nullptr;
+		void* region = mmap(nullptr, cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		return region == MAP_FAILED ? nullptr : region;
+	}
+
+	// Uses transparent huge pages rather than MAP_HUGETLB, since hugetlb needs a preallocated pool
+	// and SIGBUSes on fault when it runs dry, while THP just falls back to normal pages.
+	// The kernel only backs hugePageSize-aligned ranges with huge pages, so cap must be a multiple of
+	// hugePageSize, and we over-reserve and trim so that the region starts on a huge page boundary
+	inline void* _reserve_huge(size_t cap, bool& gotHugePages) {
+		gotHugePages = false;
+
+		const size_t padded = cap + hugePageSize;
+		void* raw = mmap(nullptr, padded, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (raw == MAP_FAILED) return nullptr;
+
+		uint8_t* rawStart = static_cast<uint8_t*>(raw);
+		uint8_t* aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(rawStart) + hugePageSize - 1) & ~(hugePageSize - 1));
+		if (aligned != rawStart) munmap(rawStart, aligned - rawStart);
+		if (aligned + cap != rawStart + padded) munmap(aligned + cap, (rawStart + padded) - (aligned + cap));
+
+#ifdef MADV_HUGEPAGE
+		gotHugePages = 0 == madvise(aligned, cap, MADV_HUGEPAGE);
+#endif
+		return aligned;
+	}
+
+	uint64_t get_page_faults() {
+		struct rusage usage;
+		if (0 != getrusage(RUSAGE_SELF, &usage)) return 0;
+		return static_cast<uint64_t>(usage.ru_minflt) + static_cast<uint64_t>(usage.ru_majflt);
 	}
 
+	// start must be page-aligned (VirtualAlloc rounds down for us, mprotect does not)
 	inline void* _commit(void* start, size_t size) {
-		return nullptr;
+		if (0 != mprotect(start, size, PROT_READ | PROT_WRITE)) return nullptr;
+		return start;
 	}
 
-	inline bool _release(void* region) {
-		return false;
+	inline bool _release(void* region, size_t cap) {
+		return 0 == munmap(region, cap);
 	}
 
+	// MADV_DONTNEED hands the physical pages back, and PROT_NONE makes the range behave as reserved again
 	inline bool _decommit(void* region, size_t size) {
-		return false;
+		if (0 != madvise(region, size, MADV_DONTNEED)) return false;
+		return 0 == mprotect(region, size, PROT_NONE);
+	}
+
+	bool map_file(MappedFile& file, const char* path) {
+		file = {};
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (0 != fstat(fd, &st) || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);    // the mapping keeps the file alive on its own
+		if (view == MAP_FAILED) return false;
+
+		// these are separate advice values rather than flags, so they can't be OR'd together
+		madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+		madvise(view, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+
+		file.data = view;
+		file.size = static_cast<size_t>(st.st_size);
+		file.slack = round_to_page_size(file.size) - file.size;
+		return true;
+	}
+
+	void unmap_file(MappedFile& file) {
+		if (file.data) munmap(const_cast<void*>(file.data), file.size);
+		file = {};
 	}
 
 #endif
@@ -130,7 +400,10 @@ namespace mems {
 
 	// This function simply loads a file into an arena
 	void* load_file(Arena& arena, const char* path, size_t& size) {
+		size = 0;
 		::FILE* fp = fopen(path, "rb");
+		if (!fp) return nullptr;
+
 		fseek(fp, 0, SEEK_END);
 		size = ftell(fp);
 		fseek(fp, 0, SEEK_SET);
@@ -141,23 +414,209 @@ namespace mems {
 		return buffer;
 	}
 
-	Arena scratchArena;
+	char* push_printf(Arena& arena, const char* fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		va_list argsCopy;
+		va_copy(argsCopy, args);
+		const int len = vsnprintf(nullptr, 0, fmt, argsCopy);
+		va_end(argsCopy);
+
+		char* str = static_cast<char*>(arena.push(len > 0 ? len + 1 : 1));
+		if (len > 0) vsnprintf(str, len + 1, fmt, args);
+		else str[0] = 0;
+		va_end(args);
+		return str;
+	}
+
+	//
+	// TELEMETRY
+	//
+
+	// Every arena that gets alloc'd is registered here, so that we can size reservations
+	// and commit granularity from what the game actually uses
+	struct TrackedArena {
+		const Arena* arena;
+		ArenaStats last;
+	};
+
+	TrackedArena trackedArenas[MAX_TRACKED];
+	int nTrackedArenas = 0;
+	ExternalStats trackedExternals[MAX_TRACKED];
+	int nTrackedExternals = 0;
+
+	// worker threads alloc their own scratch arenas, so the registry needs a lock
+	// this is only taken on alloc/dealloc/report, never on push
+	std::atomic_flag trackingLock = ATOMIC_FLAG_INIT;
+	struct TrackingGuard {
+		TrackingGuard() { while (trackingLock.test_and_set(std::memory_order_acquire)) {} }
+		~TrackingGuard() { trackingLock.clear(std::memory_order_release); }
+	};
+
+	static ArenaStats make_stats(const Arena& a, bool live) {
+		return ArenaStats{
+			.name = a.name,
+			.capacity = a.capacity,
+			.committed = a.committed,
+			.pos = a.get_pos(),
+			.peakPos = a.peakPos,
+			.nPushes = a.nPushes,
+			.nPops = a.nPops,
+			.nCommits = a.nCommits,
+			.scopeDepth = a.scopeDepth,
+			.peakScopeDepth = a.peakScopeDepth,
+			.nBlocks = a.nBlocks,
+			.flags = a.flags,
+			.hugePages = a.hugePages,
+			.live = live,
+		};
+	}
+
+	static void register_arena(const Arena& a) {
+		TrackingGuard guard;
+
+		// reuse the slot if this arena was registered before (e.g. an atlas that got recreated)
+		for (int i = 0; i < nTrackedArenas; i++) {
+			if (trackedArenas[i].arena == &a && !trackedArenas[i].last.live) {
+				trackedArenas[i].last.live = true;
+				return;
+			}
+		}
+
+		if (nTrackedArenas < MAX_TRACKED)
+			trackedArenas[nTrackedArenas++] = { &a, make_stats(a, true) };
+	}
+
+	static void unregister_arena(const Arena& a) {
+		TrackingGuard guard;
+		for (int i = 0; i < nTrackedArenas; i++) {
+			if (trackedArenas[i].arena == &a && trackedArenas[i].last.live) {
+				trackedArenas[i].last = make_stats(a, false);
+				return;
+			}
+		}
+	}
+
+	// NOTE: stats for arenas that are live on other threads are read without synchronization,
+	// so they might be slightly stale, which is fine for telemetry
+	int get_arena_stats(ArenaStats* out, int maxStats) {
+		TrackingGuard guard;
+		int n = nTrackedArenas < maxStats ? nTrackedArenas : maxStats;
+		for (int i = 0; i < n; i++) {
+			const TrackedArena& t = trackedArenas[i];
+			out[i] = t.last.live ? make_stats(*t.arena, true) : t.last;
+		}
+		return n;
+	}
+
+	int get_external_stats(ExternalStats* out, int maxStats) {
+		TrackingGuard guard;
+		int n = nTrackedExternals < maxStats ? nTrackedExternals : maxStats;
+		memcpy(out, trackedExternals, sizeof(ExternalStats) * n);
+		return n;
+	}
+
+	void track_external(const char* name, uint64_t bytes) {
+		TrackingGuard guard;
+		for (int i = 0; i < nTrackedExternals; i++) {
+			ExternalStats& e = trackedExternals[i];
+			if (0 == strcmp(e.name, name)) {
+				e.bytes = bytes;
+				if (bytes > e.peakBytes) e.peakBytes = bytes;
+				return;
+			}
+		}
+
+		if (nTrackedExternals < MAX_TRACKED)
+			trackedExternals[nTrackedExternals++] = { name, bytes, bytes };
+	}
+
+	void print_report(FILE* fp) {
+		constexpr double KB = 1024.0;
+
+		fprintf(fp, "mems report (page size %llu, commit granularity %lluKB)\n",
+			static_cast<unsigned long long>(pageSize), static_cast<unsigned long long>(commitGranularity / 1024));
+		fprintf(fp, "  %-20s %5s %12s %12s %12s %12s %10s %10s %8s %6s %6s %5s\n",
+			"arena", "live", "reserved KB", "committed KB", "pos KB", "peak KB", "pushes", "pops", "commits", "scopes", "blocks", "flags");
+
+		ArenaStats stats[MAX_TRACKED];
+		int n = get_arena_stats(stats, MAX_TRACKED);
+		for (int i = 0; i < n; i++) {
+			const ArenaStats& st = stats[i];
+			// C = chained, H = huge pages, h = huge pages were requested but we fell back to normal pages
+			const char flagStr[3] = {
+				(st.flags & Arena::CHAINED) ? 'C' : '-',
+				(st.flags & Arena::HUGE_PAGES) ? (st.hugePages ? 'H' : 'h') : '-',
+				0
+			};
+			fprintf(fp, "  %-20s %5s %12.1f %12.1f %12.1f %12.1f %10llu %10llu %8llu %3d/%-2d %6d %5s\n",
+				st.name ? st.name : "unnamed", st.live ? "yes" : "no",
+				st.capacity / KB, st.committed / KB, st.pos / KB, st.peakPos / KB,
+				static_cast<unsigned long long>(st.nPushes), static_cast<unsigned long long>(st.nPops),
+				static_cast<unsigned long long>(st.nCommits), st.scopeDepth, st.peakScopeDepth, st.nBlocks, flagStr);
+		}
+
+		ExternalStats externals[MAX_TRACKED];
+		n = get_external_stats(externals, MAX_TRACKED);
+		for (int i = 0; i < n; i++) {
+			const ExternalStats& e = externals[i];
+			fprintf(fp, "  %-20s %5s %12s %12.1f %12s %12.1f\n",
+				e.name, e.bytes ? "yes" : "no", "-", e.bytes / KB, "-", e.peakBytes / KB);
+		}
+	}
+
+	// The destructor only runs for threads other than the one that calls mems::close,
+	// which already released its own scratch arenas by that point
+	struct ThreadScratch {
+		Arena arenas[NUM_SCRATCH];
+
+		~ThreadScratch() {
+			for (int i = 0; i < NUM_SCRATCH; i++) {
+				if (arenas[i].data) arenas[i].dealloc();
+			}
+		}
+	};
+
+	thread_local ThreadScratch threadScratch;
 
 	void init() {
 		pageSize = get_page_size();
-		scratchArena.alloc();
 	}
 
 	void close() {
-		scratchArena.dealloc();
+		release_thread_scratch();
+		print_report();
 	}
 
-	Arena& get_scratch() {
+	Arena& get_scratch_excluding(const Arena* const* conflicts, int nConflicts) {
 		// we're not clearing here anymore since anyone that calls this function
 		// might not specifically want to clear the arena unnecessarily
+		for (int i = 0; i < NUM_SCRATCH; i++) {
+			Arena& candidate = threadScratch.arenas[i];
+
+			bool conflicting = false;
+			for (int j = 0; j < nConflicts; j++) {
+				if (conflicts[j] == &candidate) {
+					conflicting = true;
+					break;
+				}
+			}
+			if (conflicting) continue;
+
+			static constexpr const char* names[NUM_SCRATCH] = { "scratch0", "scratch1" };
+			if (!candidate.data) candidate.alloc(Arena::DEFAULT_CAPACITY, names[i]);
+			return candidate;
+		}
+
+		// callers should never hold more than NUM_SCRATCH - 1 scratch arenas at once
+		assert(false && "mems::get_scratch ran out of non-conflicting scratch arenas");
+		return threadScratch.arenas[0];
+	}
 
-		// scratchArena.clear();
-		return scratchArena;
+	void release_thread_scratch() {
+		for (int i = 0; i < NUM_SCRATCH; i++) {
+			if (threadScratch.arenas[i].data) threadScratch.arenas[i].dealloc();
+		}
 	}
 
 	/* Got rid of end_scratch, because like, just call scratch.clear if you really need to */
@@ -165,23 +624,123 @@ namespace mems {
 	//	a.clear();
 	//}
 
-	void Arena::alloc(uint64_t cap) {
+	void Arena::alloc(uint64_t cap, const char* arenaName, uint32_t arenaFlags) {
 		// we'll reserve 0.25GB for each Arena, which is a good spot between
 		// "too little" and "holy balls that's too much" memory
-		// when we encounter the problem of this actually being too little memory,
-		// we can probably either raise this size, or start chaining Arenas
+		// when this is actually too little memory, alloc the arena as chained
+		flags = arenaFlags;
+		name = arenaName;    // set first, so a failed commit below can say which arena it was
 		capacity = round_to_page_size(cap);
-		data = mems::_reserve(capacity);
+		data = _reserve_block(capacity);
+		assert(data != nullptr);
+		pos = 0;
 
 		// We'll commit the first page of memory, so that we can initially make use of it
-		mems::_commit(data, pageSize);
+		committed = 0;
+		_commit_to(pageSize);
+		nCommits = 0;
+
+		nBlocks = 1;
+		blockCapacity = capacity;
+		basePos = 0;
+		blockStart = 0;
+
+		peakPos = 0;
+		nPushes = nPops = 0;
+		scopeDepth = peakScopeDepth = 0;
+		register_arena(*this);
 	}
 
 	void Arena::dealloc() {
+		// snapshot before decommitting so the report keeps the final committed size
+		unregister_arena(*this);
+
 		clear_decommit(); // added this, not sure if it's really required
 		// we can do profiling and testing for that
 
-		mems::_release(data);
+		mems::_release(data, capacity);
+		data = nullptr;
+		capacity = 0;
+		committed = 0;
+	}
+
+	// Grows the committed region so that it covers at least newPos bytes
+	// This is the only place an arena talks to the OS after alloc, so the fast path of push is just a compare and an add
+	void Arena::_commit_to(size_t newPos) {
+		// huge page arenas always commit whole huge pages, otherwise the kernel can't back them with one
+		const uint64_t granularity = hugePages ? hugePageSize : commitGranularity;
+
+		size_t target = round_to_page_size(newPos);
+		if (target - committed < granularity) target = committed + granularity;
+		if (hugePages) target = (target + hugePageSize - 1) & ~(hugePageSize - 1);
+		if (target > capacity) target = capacity;
+
+		// NOTE: like running out of space, this has to fail in release builds too, otherwise push hands out
+		// memory that faults the first time it gets touched
+		void* result = mems::_commit(static_cast<uint8_t*>(data) + committed, target - committed);
+		if (!result) {
+			fprintf(stderr, "mems: arena \"%s\" could not commit %llu bytes (%llu already committed)\n", name ? name : "unnamed",
+				static_cast<unsigned long long>(target - committed), static_cast<unsigned long long>(committed));
+			abort();
+		}
+		committed = target;
+		nCommits++;
+	}
+
+	// Reserves cap bytes for a block, honoring HUGE_PAGES. cap gets rounded up if needed
+	void* Arena::_reserve_block(size_t& cap) {
+		if ((flags & HUGE_PAGES) && allowHugePages) {
+			cap = (cap + hugePageSize - 1) & ~(hugePageSize - 1);
+			return mems::_reserve_huge(cap, hugePages);
+		}
+
+		hugePages = false;
+		return mems::_reserve(cap);
+	}
+
+	// Everything needed to go back to the previous block, stored at the start of each chained block
+	struct ArenaBlockHeader {
+		void* data;
+		size_t pos, capacity, committed;
+		size_t basePos, blockStart;
+		bool hugePages;
+	};
+	static constexpr size_t BLOCK_HEADER_SIZE = (sizeof(ArenaBlockHeader) + 15) & ~static_cast<size_t>(15);
+
+	// Links in a new block that can fit at least len bytes
+	void Arena::_push_block(size_t len) {
+		const ArenaBlockHeader prev = { data, pos, capacity, committed, basePos, blockStart, hugePages };
+
+		size_t cap = blockCapacity;
+		if (len + BLOCK_HEADER_SIZE >= cap) cap = len + BLOCK_HEADER_SIZE + 1;
+
+		basePos = get_pos();
+		capacity = round_to_page_size(cap);
+		data = _reserve_block(capacity);
+		assert(data != nullptr);
+		committed = 0;
+		_commit_to(BLOCK_HEADER_SIZE);
+
+		memcpy(data, &prev, sizeof(ArenaBlockHeader));
+		pos = blockStart = BLOCK_HEADER_SIZE;
+		nBlocks++;
+	}
+
+	// Releases the current block and makes the previous one current again
+	void Arena::_pop_block() {
+		assert(nBlocks > 1);
+		ArenaBlockHeader prev;
+		memcpy(&prev, data, sizeof(ArenaBlockHeader));
+		mems::_release(data, capacity);
+
+		data = prev.data;
+		pos = prev.pos;
+		capacity = prev.capacity;
+		committed = prev.committed;
+		basePos = prev.basePos;
+		blockStart = prev.blockStart;
+		hugePages = prev.hugePages;
+		nBlocks--;
 	}
 
 	// This function is called "peek", and while it might make sense for it to be called that
@@ -194,54 +753,91 @@ namespace mems {
 
 	// Returns a pointer to len bytes of memory
 	void* Arena::push(size_t len) {
-		assert(pos + len < capacity);
-		_commit(static_cast<uint8_t*>(data) + pos, len);
+		if (pos + len >= capacity) {
+			// NOTE: this has to fail in release builds too, ArenaArray and anything else built with peek()
+			// would otherwise keep indexing past the reservation into a block that isn't next to it
+			if (!(flags & CHAINED)) {
+				fprintf(stderr, "mems: arena \"%s\" ran out of space (%llu + %llu bytes, capacity %llu)\n", name ? name : "unnamed",
+					static_cast<unsigned long long>(pos), static_cast<unsigned long long>(len), static_cast<unsigned long long>(capacity));
+				abort();
+			}
+			_push_block(len);
+		}
+
+		if (pos + len > committed) _commit_to(pos + len);
 		uint64_t prev = pos;
 		pos += len;
+		if (get_pos() > peakPos) peakPos = get_pos();
+		nPushes++;
 		return static_cast<uint8_t*>(data) + prev;
 	}
 
 	// Copies pData into the arena and returns a pointer to it
 	void* Arena::push_data(const void* pData, size_t sizeData) {
-		assert(pos + sizeData < capacity);
-		_commit(static_cast<uint8_t*>(data) + pos, sizeData);
-		uint64_t prev = pos;
-		memcpy(static_cast<uint8_t*>(data) + pos, pData, sizeData);
-		pos += sizeData;
-		return static_cast<uint8_t*>(data) + prev;
+		void* dst = push(sizeData);
+		memcpy(dst, pData, sizeData);
+		return dst;
 	}
 
 	// Returns a pointer to len zero-initialized bytes
 	void* Arena::push_zero(size_t len) {
-		assert(pos + len < capacity);
-		_commit(static_cast<uint8_t*>(data) + pos, len);
-		uint64_t prev = pos;
-		memset(static_cast<uint8_t*>(data) + pos, 0, len);
-		pos += len;
-		return static_cast<uint8_t*>(data) + prev;
+		void* dst = push(len);
+		memset(dst, 0, len);
+		return dst;
+	}
+
+	// Returns a pointer to len bytes starting on an align boundary, the padding before it is just skipped
+	void* Arena::push_aligned(size_t len, size_t align) {
+		assert(align != 0 && (align & (align - 1)) == 0);
+		size_t padding = (align - (reinterpret_cast<uintptr_t>(peek()) & (align - 1))) & (align - 1);
+		// NOTE: a new block's data only starts on a BLOCK_HEADER_SIZE boundary, so chain here instead of letting push()
+		// do it and work the padding out again against the new block
+		if ((flags & CHAINED) && pos + padding + len >= capacity) {
+			_push_block(len + align);
+			padding = (align - (reinterpret_cast<uintptr_t>(peek()) & (align - 1))) & (align - 1);
+		}
+		return static_cast<uint8_t*>(push(padding + len)) + padding;
+	}
+
+	// Returns a pointer to len zero-initialized bytes starting on an align boundary
+	void* Arena::push_zero_aligned(size_t len, size_t align) {
+		void* dst = push_aligned(len, align);
+		memset(dst, 0, len);
+		return dst;
 	}
 
 	// Undoes the most recent len bytes of allocation
 	void Arena::pop(size_t len) {
-		if (len > pos) pos = 0;
-		else pos -= len;
+		const size_t current = get_pos();
+		pop_to(len > current ? 0 : current - len);
 	}
 
 	// Instead of deallocating the top x bytes in the arena,
 	// we "cut" the allocated bytes to newPos
+	// For chained arenas, any block that lies entirely past newPos gets released
 	void Arena::pop_to(size_t newPos) {
-		if (newPos > pos) return;
-		pos = newPos;
+		if (newPos > get_pos()) return;
+		nPops++;
+
+		while (nBlocks > 1 && newPos < basePos) _pop_block();
+		pos = newPos - basePos + blockStart;
 	}
 
 	void Arena::clear() {
-		pos = 0;
+		pop_to(0);
 	}
 
-	// Decommits all memory except the first page
+	// Releases all chained blocks and decommits all memory except the first page
 	void Arena::clear_decommit() {
-		_decommit(static_cast<uint8_t*>(data) + pageSize, pos - pageSize);
 		clear();
+
+		// huge page arenas keep their first huge page, so that it doesn't get split up
+		const size_t keep = hugePages ? hugePageSize : pageSize;
+		if (committed > keep) {
+			_decommit(static_cast<uint8_t*>(data) + keep, committed - keep);
+			committed = keep;
+			nCommits++;
+		}
 	}
 
 	/* ArenaScope is handy, and the following example might illustrate why:
@@ -256,11 +852,13 @@ namespace mems {
 	*	}
 	*/
 	ArenaScope::ArenaScope(Arena& a) : arena(a) {
-		startPos = a.pos;
+		startPos = a.get_pos();
+		if (++a.scopeDepth > a.peakScopeDepth) a.peakScopeDepth = a.scopeDepth;
 	}
 
 	ArenaScope::~ArenaScope() {
 		arena.pop_to(startPos);
+		arena.scopeDepth--;
 	}
 
 }
@@ -14,6 +14,10 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+#include <mems.hpp>
 using i8 = int8_t;
 using u8 = uint8_t;
 using i16 = int16_t;
@@ -239,6 +243,423 @@ namespace tds {
 		}
 	};
 
+	// Handle into a Pool. The generation makes lookups of despawned objects fail,
+	// instead of silently returning whatever got spawned into the same slot afterwards
+	struct PoolHandle {
+		u32 slot = UINT32_MAX;
+		u32 generation = 0;
+
+		bool operator==(const PoolHandle&) const = default;
+	};
+
+	// Generational slot map with a fixed capacity
+	// Live objects are packed into dense[0, size), so iterating only ever touches live objects.
+	// Handles go through the slots table, so they stay valid while objects move around inside dense.
+	// Storage comes from an arena (anything with push_zero_aligned works), so there is no heap traffic after init.
+	//
+	// despawn_at swaps the last object into the freed spot, so despawning while iterating looks like:
+	//	for (u32 i = 0; i < pool.size;) {
+	//		if (pool[i].dead) pool.despawn_at(i);
+	//		else i++;
+	//	}
+	template<typename T>
+	struct Pool {
+		static constexpr u32 INVALID = UINT32_MAX;
+
+		struct Slot {
+			u32 denseIdx;    // for free slots, this is the index of the next free slot instead
+			u32 generation;
+		};
+
+		T* dense = nullptr;
+		u32* denseToSlot = nullptr;
+		Slot* slots = nullptr;
+		u32 freeHead = INVALID;
+		u32 size = 0;
+		u32 capacity = 0;
+
+		template<typename ArenaT>
+		void init(ArenaT& arena, u32 cap) {
+			capacity = cap;
+			size = 0;
+			dense = static_cast<T*>(arena.push_zero_aligned(sizeof(T) * cap, alignof(T)));
+			denseToSlot = static_cast<u32*>(arena.push_zero_aligned(sizeof(u32) * cap, alignof(u32)));
+			slots = static_cast<Slot*>(arena.push_zero_aligned(sizeof(Slot) * cap, alignof(Slot)));
+
+			for (u32 i = 0; i < cap; i++) {
+				slots[i].denseIdx = (i + 1 < cap) ? i + 1 : INVALID;
+				slots[i].generation = 1;
+			}
+			freeHead = cap ? 0 : INVALID;
+		}
+
+		// returns nullptr when the pool is full
+		T* spawn(PoolHandle* outHandle = nullptr) {
+			if (freeHead == INVALID) return nullptr;
+
+			const u32 slotIdx = freeHead;
+			Slot& slot = slots[slotIdx];
+			freeHead = slot.denseIdx;
+
+			slot.denseIdx = size;
+			denseToSlot[size] = slotIdx;
+			T* obj = new (&dense[size]) T();
+			size++;
+
+			if (outHandle) *outHandle = { slotIdx, slot.generation };
+			return obj;
+		}
+
+		void despawn_at(u32 denseIdx) {
+			assert(denseIdx < size);
+			const u32 slotIdx = denseToSlot[denseIdx];
+			const u32 last = size - 1;
+
+			dense[denseIdx].~T();
+			if (denseIdx != last) {
+				new (&dense[denseIdx]) T(static_cast<T&&>(dense[last]));
+				dense[last].~T();
+				denseToSlot[denseIdx] = denseToSlot[last];
+				slots[denseToSlot[denseIdx]].denseIdx = denseIdx;
+			}
+			size--;
+
+			Slot& slot = slots[slotIdx];
+			slot.generation++;
+			slot.denseIdx = freeHead;
+			freeHead = slotIdx;
+		}
+
+		// returns false if the handle was already stale
+		bool despawn(PoolHandle handle) {
+			const T* obj = get(handle);
+			if (!obj) return false;
+			despawn_at(static_cast<u32>(obj - dense));
+			return true;
+		}
+
+		void clear() {
+			while (size > 0) despawn_at(size - 1);
+		}
+
+		T* get(PoolHandle handle) {
+			if (handle.slot >= capacity) return nullptr;
+			const Slot& slot = slots[handle.slot];
+			if (slot.generation != handle.generation) return nullptr;
+			return &dense[slot.denseIdx];
+		}
+
+		PoolHandle handle_at(u32 denseIdx) const {
+			assert(denseIdx < size);
+			const u32 slotIdx = denseToSlot[denseIdx];
+			return { slotIdx, slots[slotIdx].generation };
+		}
+
+		PoolHandle handle_of(const T& obj) const {
+			return handle_at(static_cast<u32>(&obj - dense));
+		}
+
+		bool full() const { return size == capacity; }
+
+		T& operator[](u32 i) { return dense[i]; }
+		T* begin() { return dense; }
+		T* end() { return dense + size; }
+	};
+
+	// FNV-1a, constexpr so that it also works on string literals at compile time
+	constexpr u64 fnv1a(const char* str, size_t len) {
+		u64 hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < len; i++) {
+			hash ^= static_cast<u8>(str[i]);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	constexpr u64 fnv1a(std::string_view str) {
+		return fnv1a(str.data(), str.length());
+	}
+
+	// splitmix64 finalizer, spreads integer keys (which are often sequential) over the whole table
+	constexpr u64 mix64(u64 x) {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	template<typename K>
+	u64 hash(const K& key) {
+		if constexpr (std::is_integral_v<K> || std::is_enum_v<K>)
+			return mix64(static_cast<u64>(key));
+		else if constexpr (std::is_pointer_v<K>)
+			return mix64(static_cast<u64>(reinterpret_cast<uintptr_t>(key)));
+		else
+			return fnv1a(reinterpret_cast<const char*>(&key), sizeof(K));
+	}
+
+	// Stable LSD radix sort of 64 bit keys, a byte per pass
+	// Only bytes [firstByte, lastByte) are sorted on, so whatever sits in the bytes below firstByte (e.g. an index)
+	// just gets carried along. Bytes that are the same in every key don't get a pass at all.
+	// tmp needs room for n keys, returns whichever of keys/tmp ended up with the sorted keys
+	inline u64* radix_sort(u64* keys, u64* tmp, u32 n, u32 firstByte = 0, u32 lastByte = 8) {
+		assert(firstByte <= lastByte && lastByte <= 8);
+		if (n < 2) return keys;
+
+		// all the histograms in a single read
+		u32 counts[8][256];
+		memset(counts, 0, sizeof(counts));
+		for (u32 i = 0; i < n; i++) {
+			for (u32 b = firstByte; b < lastByte; b++)
+				counts[b][(keys[i] >> (b * 8)) & 0xFF]++;
+		}
+
+		for (u32 b = firstByte; b < lastByte; b++) {
+			const u32 shift = b * 8;
+			u32* count = counts[b];
+			if (count[(keys[0] >> shift) & 0xFF] == n) continue;
+
+			u32 sum = 0;
+			for (int d = 0; d < 256; d++) {
+				const u32 c = count[d];
+				count[d] = sum;
+				sum += c;
+			}
+
+			for (u32 i = 0; i < n; i++)
+				tmp[count[(keys[i] >> shift) & 0xFF]++] = keys[i];
+
+			u64* sorted = tmp;
+			tmp = keys;
+			keys = sorted;
+		}
+
+		return keys;
+	}
+
+	// Same sort with 12 bit digits over bits [firstBit, lastBit), rounded up to whole digits
+	// A 24 bit key is 2 passes instead of 3. The histograms are 16kb each though, so for a few thousand keys or less
+	// the byte version is cheaper
+	inline u64* radix_sort_12(u64* keys, u64* tmp, u32 n, u32 firstBit, u32 lastBit) {
+		static constexpr u32 DIGIT_BITS = 12;
+		static constexpr u32 RADIX = 1 << DIGIT_BITS;
+		static constexpr u32 MAX_DIGITS = 3;
+		const u32 nDigits = (lastBit - firstBit + DIGIT_BITS - 1) / DIGIT_BITS;
+		assert(firstBit <= lastBit && lastBit <= 64 && nDigits <= MAX_DIGITS);
+		if (n < 2) return keys;
+
+		u32 counts[MAX_DIGITS][RADIX];
+		memset(counts, 0, sizeof(counts[0]) * nDigits);
+		for (u32 i = 0; i < n; i++) {
+			for (u32 d = 0; d < nDigits; d++)
+				counts[d][(keys[i] >> (firstBit + d * DIGIT_BITS)) & (RADIX - 1)]++;
+		}
+
+		for (u32 d = 0; d < nDigits; d++) {
+			const u32 shift = firstBit + d * DIGIT_BITS;
+			u32* count = counts[d];
+			if (count[(keys[0] >> shift) & (RADIX - 1)] == n) continue;
+
+			u32 sum = 0;
+			for (u32 v = 0; v < RADIX; v++) {
+				const u32 c = count[v];
+				count[v] = sum;
+				sum += c;
+			}
+
+			for (u32 i = 0; i < n; i++)
+				tmp[count[(keys[i] >> shift) & (RADIX - 1)]++] = keys[i];
+
+			u64* sorted = tmp;
+			tmp = keys;
+			keys = sorted;
+		}
+
+		return keys;
+	}
+
+	// Growable array that owns its own arena reservation
+	// Since nothing else pushes into that reservation, growing only commits more of it in place:
+	// there's no reallocation, no copying, and pointers into the array stay valid until release()
+	template<typename T>
+	struct ArenaArray {
+		T* data = nullptr;
+		u32 size = 0;
+		u32 capacity = 0;    // max number of elements the reservation can hold
+		mems::Arena arena = {};
+
+		// only address space for maxCount elements gets reserved here, memory is committed as the array grows
+		void init(u32 maxCount, const char* name = "ArenaArray") {
+			arena.alloc(sizeof(T) * static_cast<u64>(maxCount) + 1, name);
+			data = static_cast<T*>(arena.peek());
+			size = 0;
+			capacity = static_cast<u32>((arena.capacity - 1) / sizeof(T));
+		}
+
+		void release() {
+			clear();
+			arena.dealloc();
+			data = nullptr;
+			capacity = 0;
+		}
+
+		template<typename... Args>
+		T& emplace(Args&&... args) {
+			assert(size < capacity);
+			T* obj = new (arena.push(sizeof(T))) T(static_cast<Args&&>(args)...);
+			size++;
+			return *obj;
+		}
+
+		T& push(const T& value) {
+			return emplace(value);
+		}
+
+		void pop() {
+			assert(size > 0);
+			data[--size].~T();
+			arena.pop(sizeof(T));
+		}
+
+		// keeps the committed memory around, so refilling the array doesn't go to the OS again
+		void clear() {
+			for (u32 i = 0; i < size; i++) data[i].~T();
+			size = 0;
+			arena.clear();
+		}
+
+		T& operator[](u32 i) { assert(i < size); return data[i]; }
+		const T& operator[](u32 i) const { assert(i < size); return data[i]; }
+		T* begin() { return data; }
+		T* end() { return data + size; }
+		const T* begin() const { return data; }
+		const T* end() const { return data + size; }
+	};
+
+	// Open-addressing hash map (linear probing) with its tables allocated from an arena
+	// When it gets too full, the table is rebuilt at twice the size in the same arena and the old table is simply
+	// abandoned, so give it an arena with a matching lifetime (or init it with enough capacity up front).
+	// Keys are compared with ==, so for string keys, key the map by tds::fnv1a of the string instead of by pointer
+	template<typename K, typename V>
+	struct ArenaMap {
+		enum SlotState : u8 {
+			EMPTY = 0,
+			FULL,
+			TOMBSTONE,
+		};
+
+		struct Entry {
+			K key;
+			V value;
+		};
+
+		Entry* entries = nullptr;
+		u8* states = nullptr;
+		u32 capacity = 0;    // always a power of 2
+		u32 size = 0;
+		u32 tombstones = 0;
+		mems::Arena* arena = nullptr;
+
+		// room for minCapacity entries without having to rebuild the table
+		void init(mems::Arena& a, u32 minCapacity = 16) {
+			arena = &a;
+			size = 0;
+			tombstones = 0;
+
+			u32 cap = 16;
+			while (cap * 3 < minCapacity * 4) cap *= 2;
+			_alloc_table(cap);
+		}
+
+		V* find(const K& key) {
+			const u32 idx = _find_slot(key);
+			return (idx != UINT32_MAX && states[idx] == FULL) ? &entries[idx].value : nullptr;
+		}
+
+		const V* find(const K& key) const {
+			return const_cast<ArenaMap*>(this)->find(key);
+		}
+
+		// inserts key, or overwrites its value if it's already in the map
+		V& put(const K& key, const V& value) {
+			if ((size + tombstones + 1) * 4 > capacity * 3)
+				_rebuild(size * 2 >= capacity ? capacity * 2 : capacity);
+
+			const u64 mask = capacity - 1;
+			u32 firstTombstone = UINT32_MAX;
+			for (u64 i = hash(key) & mask;; i = (i + 1) & mask) {
+				if (states[i] == FULL && entries[i].key == key) {
+					entries[i].value = value;
+					return entries[i].value;
+				}
+
+				if (states[i] == TOMBSTONE && firstTombstone == UINT32_MAX)
+					firstTombstone = static_cast<u32>(i);
+
+				if (states[i] == EMPTY) {
+					u32 idx = static_cast<u32>(i);
+					if (firstTombstone != UINT32_MAX) {
+						idx = firstTombstone;
+						tombstones--;
+					}
+
+					states[idx] = FULL;
+					entries[idx] = { key, value };
+					size++;
+					return entries[idx].value;
+				}
+			}
+		}
+
+		bool remove(const K& key) {
+			const u32 idx = _find_slot(key);
+			if (idx == UINT32_MAX || states[idx] != FULL) return false;
+
+			states[idx] = TOMBSTONE;
+			size--;
+			tombstones++;
+			return true;
+		}
+
+		void clear() {
+			memset(states, EMPTY, capacity);
+			size = 0;
+			tombstones = 0;
+		}
+
+	private:
+		void _alloc_table(u32 cap) {
+			capacity = cap;
+			entries = static_cast<Entry*>(arena->push_aligned(sizeof(Entry) * cap, alignof(Entry)));
+			states = static_cast<u8*>(arena->push_zero(cap));
+		}
+
+		// returns the slot holding key, or UINT32_MAX if it isn't in the map
+		u32 _find_slot(const K& key) const {
+			const u64 mask = capacity - 1;
+			for (u64 i = hash(key) & mask, n = 0; n < capacity; i = (i + 1) & mask, n++) {
+				if (states[i] == EMPTY) return UINT32_MAX;
+				if (states[i] == FULL && entries[i].key == key) return static_cast<u32>(i);
+			}
+			return UINT32_MAX;
+		}
+
+		void _rebuild(u32 newCapacity) {
+			Entry* oldEntries = entries;
+			u8* oldStates = states;
+			const u32 oldCapacity = capacity;
+
+			_alloc_table(newCapacity);
+			size = 0;
+			tombstones = 0;
+			for (u32 i = 0; i < oldCapacity; i++) {
+				if (oldStates[i] == FULL) put(oldEntries[i].key, oldEntries[i].value);
+			}
+		}
+	};
+
 	template<u32 NumStates>
 	struct StateMachine {
 		static constexpr u32 maxStates = NumStates;
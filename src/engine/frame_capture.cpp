@@ -0,0 +1,361 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "frame_capture.h"
+
+#include <SDL3/SDL_thread.h>
+#include <SDL3/SDL_mutex.h>
+
+#include <string.h>
+
+#include <tinydef.hpp>
+
+#include "engine/image_asset.h"
+
+bool FrameCapture::start(const char* path, Format format, int width, int height, int fps) {
+	assert(!is_recording());
+	wait();
+
+	this->format = format;
+	this->width = width;
+	this->height = height;
+	snprintf(this->path, sizeof(this->path), "%s", path);
+
+	if (format == Y4M) {
+		video = fopen(path, "wb");
+		if (!video) {
+			fprintf(stderr, "Could not open %s for recording\n", path);
+			return false;
+		}
+		fprintf(video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+	}
+
+	// the pool and the writer's scratch are all allocated up front, recording never allocates
+	const size_t frameSize = sizeof(uint32_t) * width * height;
+	const size_t pngSize = static_cast<size_t>(height) * (1 + width * 3) + 1024;    // rows + filter bytes, stored deflate blocks and chunks
+	const size_t encodeSize = tim::max(pngSize + pngSize / 65535 * 5, static_cast<size_t>(width) * height * 3);
+	const size_t quadsSize = sizeof(SDL_Vertex) * 4 * MAX_QUADS + sizeof(QuadBatch) * MAX_BATCHES + alignof(SDL_Vertex) + alignof(QuadBatch);
+	arena.alloc((frameSize + quadsSize) * POOL_SIZE + encodeSize + 1, "FrameCapture");
+	for (Slot& slot : slots) {
+		slot.state = FREE;
+		slot.pixels = static_cast<uint32_t*>(arena.push(frameSize));
+		memset(slot.pixels, 0, frameSize);    // NOTE: touch the pages now, otherwise the first frames pay for the page faults
+		// these only get touched by the hardware backend, and only as far as its frames go
+		slot.vertices = static_cast<SDL_Vertex*>(arena.push_aligned(sizeof(SDL_Vertex) * 4 * MAX_QUADS, alignof(SDL_Vertex)));
+		slot.batches = static_cast<QuadBatch*>(arena.push_aligned(sizeof(QuadBatch) * MAX_BATCHES, alignof(QuadBatch)));
+	}
+	encodeBuffer = static_cast<uint8_t*>(arena.push(encodeSize));
+	raster.init(width, height);
+	nextAcquire = 0;
+	nextWrite = 0;
+	framesCaptured = 0;
+	framesDropped = 0;
+
+	stopping = false;
+	queued = SDL_CreateSemaphore(0);
+	thread = SDL_CreateThread(_writer_main, "FrameCapture", this);
+	if (!thread) {
+		fprintf(stderr, "Could not start the frame capture thread: %s\n", SDL_GetError());
+		SDL_DestroySemaphore(queued);
+		queued = nullptr;
+		if (video) fclose(video);
+		video = nullptr;
+		raster.cleanup();
+		arena.dealloc();
+		return false;
+	}
+	recording = true;
+	return true;
+}
+
+// NOTE: this runs on the game thread (F11), so it only tells the writer to finish up. Joining it here would stall the
+// game for as long as the queued frames take to write
+void FrameCapture::stop() {
+	if (!is_recording()) return;
+
+	recording = false;
+	stopping = true;
+	SDL_SignalSemaphore(queued);
+
+	printf("FrameCapture: %u frames captured, %u dropped\n", framesCaptured, framesDropped);
+}
+
+void FrameCapture::wait() {
+	if (!thread) return;
+	assert(!is_recording());
+
+	SDL_WaitThread(thread, nullptr);
+	thread = nullptr;
+
+	SDL_DestroySemaphore(queued);
+	queued = nullptr;
+	if (video) fclose(video);
+	video = nullptr;
+	raster.cleanup();
+	arena.dealloc();
+	encodeBuffer = nullptr;
+}
+
+uint32_t* FrameCapture::acquire() {
+	if (!is_recording()) return nullptr;
+
+	Slot& slot = slots[nextAcquire % POOL_SIZE];
+	if (slot.state.load(std::memory_order_acquire) != FREE) {
+		framesDropped++;
+		return nullptr;
+	}
+
+	slot.state.store(ACQUIRED, std::memory_order_relaxed);
+	slot.hasQuads = false;
+	return slot.pixels;
+}
+
+void FrameCapture::submit(uint32_t* buffer) {
+	Slot& slot = slots[nextAcquire % POOL_SIZE];
+	assert(buffer == slot.pixels && slot.state.load(std::memory_order_relaxed) == ACQUIRED);
+
+	slot.state.store(QUEUED, std::memory_order_release);
+	nextAcquire++;
+	framesCaptured++;
+	SDL_SignalSemaphore(queued);
+}
+
+bool FrameCapture::acquire_quads(const TextureAtlas& atlas, const SDL_FColor& clearColor) {
+	if (!acquire()) return false;
+
+	Slot& slot = slots[nextAcquire % POOL_SIZE];
+	slot.hasQuads = true;
+	slot.overflowed = false;
+	slot.clearColor = clearColor;
+	slot.atlas = &atlas;
+	slot.nQuads = 0;
+	slot.nBatches = 0;
+	return true;
+}
+
+void FrameCapture::add_quads(const SDL_Vertex* verts, uint32_t nQuads, int page, const uint32_t* palette) {
+	Slot& slot = slots[nextAcquire % POOL_SIZE];
+	assert(slot.hasQuads && slot.state.load(std::memory_order_relaxed) == ACQUIRED);
+	if (nQuads == 0 || slot.overflowed) return;
+	if (slot.nQuads + nQuads > MAX_QUADS || slot.nBatches == MAX_BATCHES) {
+		slot.overflowed = true;
+		return;
+	}
+
+	// the palettes array can still grow on this thread, so the writer gets the colors themselves
+	const TextureAtlas& atlas = *slot.atlas;
+	if (!palette && page >= 0 && atlas.indexedData) palette = atlas.palettes[TextureAtlas::BASE_PALETTE].colors;
+
+	memcpy(slot.vertices + slot.nQuads * 4, verts, sizeof(SDL_Vertex) * 4 * nQuads);
+	slot.batches[slot.nBatches++] = QuadBatch{ page, palette, slot.nQuads, nQuads };
+	slot.nQuads += nQuads;
+}
+
+void FrameCapture::submit_quads() {
+	Slot& slot = slots[nextAcquire % POOL_SIZE];
+	assert(slot.hasQuads);
+	if (slot.overflowed) {
+		// partially drawn would be worse than missing, so it counts as dropped
+		slot.state.store(FREE, std::memory_order_relaxed);
+		framesDropped++;
+		return;
+	}
+	submit(slot.pixels);
+}
+
+int FrameCapture::_writer_main(void* self) {
+	FrameCapture& capture = *static_cast<FrameCapture*>(self);
+	uint32_t frameIdx = 0;
+
+	while (true) {
+		SDL_WaitSemaphore(capture.queued);
+
+		// write out everything that's queued, in order. When stopping, this is also what drains the pool
+		while (true) {
+			Slot& slot = capture.slots[capture.nextWrite % POOL_SIZE];
+			if (slot.state.load(std::memory_order_acquire) != QUEUED) break;
+
+			if (slot.hasQuads) {
+				capture._draw_quads(slot);
+				capture._write_frame(capture.raster.pixels, frameIdx++);
+			} else {
+				capture._write_frame(slot.pixels, frameIdx++);
+			}
+			slot.state.store(FREE, std::memory_order_release);
+			capture.nextWrite++;
+		}
+
+		if (capture.stopping.load(std::memory_order_acquire)) break;
+	}
+
+	return 0;
+}
+
+// the same thing Gfx::_flush_batches does for the software backend
+void FrameCapture::_draw_quads(const Slot& slot) {
+	const TextureAtlas& atlas = *slot.atlas;
+	const int w = atlas.width, h = atlas.height;
+
+	raster.clear(slot.clearColor);
+	for (uint32_t i = 0; i < slot.nBatches; i++) {
+		const QuadBatch& batch = slot.batches[i];
+		if (batch.page >= 0) {
+			if (atlas.indexedData) raster.set_indexed_texture(atlas.indexedData + static_cast<size_t>(w) * h * batch.page, w, h);
+			else raster.set_texture(atlas.page_data(batch.page), w, h);
+		}
+		raster.draw_quads(slot.vertices + batch.firstQuad * 4, batch.nQuads, batch.page >= 0, batch.palette);
+	}
+}
+
+void FrameCapture::_write_frame(const uint32_t* pixels, uint32_t frameIdx) {
+	if (format == Y4M) {
+		_write_y4m_frame(pixels);
+		return;
+	}
+
+	char filePath[sizeof(path) + 16];
+	snprintf(filePath, sizeof(filePath), "%s_%06u.png", path, frameIdx);
+	_write_png(filePath, pixels);
+}
+
+//
+// Y4M
+//
+
+// BT.601 studio range, the same thing ffmpeg assumes for y4m without a colorspace tag
+void FrameCapture::_write_y4m_frame(const uint32_t* pixels) {
+	const int n = width * height;
+	uint8_t* yPlane = encodeBuffer;
+	uint8_t* uPlane = encodeBuffer + n;
+	uint8_t* vPlane = encodeBuffer + n * 2;
+
+	for (int i = 0; i < n; i++) {
+		const int r = pixels[i] & 0xFF;
+		const int g = (pixels[i] >> 8) & 0xFF;
+		const int b = (pixels[i] >> 16) & 0xFF;
+		yPlane[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		uPlane[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		vPlane[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+
+	fwrite("FRAME\n", 1, 6, video);
+	fwrite(encodeBuffer, 1, static_cast<size_t>(n) * 3, video);
+}
+
+//
+// PNG
+//
+// NOTE: we don't have a deflate implementation, so the image data goes into "stored" (uncompressed) deflate blocks.
+// Files come out around 180kb, but any png reader takes them and there's no time spent compressing
+
+static uint32_t crcTable[256];
+
+static void init_crc_table() {
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		crcTable[n] = c;
+	}
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++) crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint8_t* put_u32_be(uint8_t* p, uint32_t v) {
+	p[0] = static_cast<uint8_t>(v >> 24);
+	p[1] = static_cast<uint8_t>(v >> 16);
+	p[2] = static_cast<uint8_t>(v >> 8);
+	p[3] = static_cast<uint8_t>(v);
+	return p + 4;
+}
+
+// writes length, type, data and crc of a chunk whose type + data were already written at chunk + 4
+static void finish_png_chunk(uint8_t* chunk, uint32_t dataLen) {
+	put_u32_be(chunk, dataLen);
+	put_u32_be(chunk + 8 + dataLen, crc32(0, chunk + 4, dataLen + 4));
+}
+
+bool FrameCapture::_write_png(const char* filePath, const uint32_t* pixels) {
+	static bool crcReady = false;
+	if (!crcReady) {
+		init_crc_table();
+		crcReady = true;
+	}
+
+	uint8_t* out = encodeBuffer;
+	static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	memcpy(out, SIGNATURE, 8);
+	out += 8;
+
+	// IHDR: 8 bit RGB, no interlacing
+	uint8_t* chunk = out;
+	memcpy(chunk + 4, "IHDR", 4);
+	uint8_t* p = put_u32_be(chunk + 8, width);
+	p = put_u32_be(p, height);
+	*p++ = 8;
+	*p++ = 2;
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 0;
+	finish_png_chunk(chunk, 13);
+	out = chunk + 12 + 13;
+
+	// IDAT: zlib header, stored blocks of at most 65535 bytes, adler32
+	chunk = out;
+	memcpy(chunk + 4, "IDAT", 4);
+	p = chunk + 8;
+	*p++ = 0x78;
+	*p++ = 0x01;
+
+	const uint32_t rowSize = 1 + width * 3;
+	const uint32_t rawSize = rowSize * height;
+	uint32_t blockLeft = 0;
+	uint32_t rawLeft = rawSize;
+	uint32_t adlerA = 1, adlerB = 0;
+	auto put_raw = [&](uint8_t byte) {
+		if (blockLeft == 0) {
+			blockLeft = tim::min<uint32_t>(rawLeft, 65535);
+			*p++ = rawLeft == blockLeft ? 1 : 0;    // last block?
+			*p++ = static_cast<uint8_t>(blockLeft);
+			*p++ = static_cast<uint8_t>(blockLeft >> 8);
+			*p++ = static_cast<uint8_t>(~blockLeft);
+			*p++ = static_cast<uint8_t>(~blockLeft >> 8);
+		}
+		*p++ = byte;
+		blockLeft--;
+		rawLeft--;
+		adlerA = (adlerA + byte) % 65521;
+		adlerB = (adlerB + adlerA) % 65521;
+	};
+
+	for (int y = 0; y < height; y++) {
+		put_raw(0);    // no filter
+		const uint32_t* row = pixels + y * width;
+		for (int x = 0; x < width; x++) {
+			put_raw(static_cast<uint8_t>(row[x]));
+			put_raw(static_cast<uint8_t>(row[x] >> 8));
+			put_raw(static_cast<uint8_t>(row[x] >> 16));
+		}
+	}
+	p = put_u32_be(p, (adlerB << 16) | adlerA);
+
+	const uint32_t idatLen = static_cast<uint32_t>(p - (chunk + 8));
+	finish_png_chunk(chunk, idatLen);
+	out = chunk + 12 + idatLen;
+
+	chunk = out;
+	memcpy(chunk + 4, "IEND", 4);
+	finish_png_chunk(chunk, 0);
+	out = chunk + 12;
+
+	::FILE* fp = fopen(filePath, "wb");
+	if (!fp) {
+		fprintf(stderr, "Could not open %s for a captured frame\n", filePath);
+		return false;
+	}
+	fwrite(encodeBuffer, 1, out - encodeBuffer, fp);
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+#include <mems.hpp>
+
+#include "engine/soft_raster.h"
+
+struct TextureAtlas;
+
+// Records frames to disk without the game thread ever waiting on it
+// Gfx copies each finished frame into one of POOL_SIZE preallocated buffers (see Gfx::capture), and a background
+// thread writes them out in order as PNG stills or one raw Y4M video. If the writer falls behind and every buffer is
+// still queued, the frame is dropped (and counted) instead of stalling the game
+// The hardware backend can't get its pixels back without waiting on the gpu, so it hands over the quads it drew
+// instead, and the writer draws them again with its own SoftRaster (which blends the same way, see soft_raster.h)
+struct FrameCapture {
+	enum Format {
+		PNG,    // path is a prefix, frames get written to <path>_000000.png, <path>_000001.png...
+		Y4M,    // path is the video file, 4:4:4 so nothing is lost to chroma subsampling
+	};
+
+	static constexpr uint32_t POOL_SIZE = 8;
+	static constexpr uint32_t MAX_QUADS = 1 << 13;    // per frame, for submit_quads. A frame with more gets dropped
+	static constexpr uint32_t MAX_BATCHES = 1 << 10;
+
+	// if the last recording is still being written out, this waits for it first
+	bool start(const char* path, Format format, int width, int height, int fps);
+	// stops taking frames, whatever is still queued gets written out in the background
+	void stop();
+	// waits for the writer to finish everything queued, call it before shutting down
+	void wait();
+	bool is_recording() const { return recording; }
+
+	// game thread only: a buffer for width * height RGBA8 pixels (R in the lowest byte), or nullptr if they're all queued
+	// every buffer that's acquired has to be submitted
+	uint32_t* acquire();
+	void submit(uint32_t* buffer);
+
+	// game thread only, the same thing for the quads of a frame: acquire_quads, add_quads for every batch that gets
+	// drawn (in order), then submit_quads. The atlas is read on the writer thread, so it can't change while recording
+	bool acquire_quads(const TextureAtlas& atlas, const SDL_FColor& clearColor);
+	// page is -1 for untextured quads, palette is only for the indexed atlas (nullptr uses the atlas' own colors)
+	void add_quads(const SDL_Vertex* verts, uint32_t nQuads, int page, const uint32_t* palette);
+	void submit_quads();
+
+	uint32_t framesCaptured = 0;
+	uint32_t framesDropped = 0;
+
+private:
+	enum SlotState : uint32_t {
+		FREE,
+		ACQUIRED,
+		QUEUED,
+	};
+
+	// NOTE: single producer (game thread), single consumer (writer thread), and slots are handed out and written
+	// in the same round robin order, so the slot states are the only thing that needs to be synchronized
+	struct QuadBatch {
+		int page;
+		const uint32_t* palette;
+		uint32_t firstQuad;
+		uint32_t nQuads;
+	};
+
+	struct Slot {
+		std::atomic<uint32_t> state;
+		uint32_t* pixels;
+
+		// only for frames from submit_quads
+		bool hasQuads;
+		bool overflowed;
+		SDL_FColor clearColor;
+		const TextureAtlas* atlas;
+		SDL_Vertex* vertices;
+		uint32_t nQuads;
+		QuadBatch* batches;
+		uint32_t nBatches;
+	};
+	Slot slots[POOL_SIZE];
+	uint32_t nextAcquire = 0;
+	uint32_t nextWrite = 0;
+
+	Format format = PNG;
+	int width = 0, height = 0;
+	char path[256] = {};
+	::FILE* video = nullptr;
+
+	bool recording = false;
+	struct SDL_Thread* thread = nullptr;    // still set after stop() until wait(), while the writer drains the queue
+	struct SDL_Semaphore* queued = nullptr;    // counts submitted frames, the writer sleeps on it
+	std::atomic<bool> stopping = false;
+	mems::Arena arena;
+	uint8_t* encodeBuffer = nullptr;    // writer thread only
+	SoftRaster raster;    // writer thread only, draws the frames from submit_quads
+
+	static int _writer_main(void* self);
+	void _draw_quads(const Slot& slot);
+	void _write_frame(const uint32_t* pixels, uint32_t frameIdx);
+	bool _write_png(const char* filePath, const uint32_t* pixels);
+	void _write_y4m_frame(const uint32_t* pixels);
+};
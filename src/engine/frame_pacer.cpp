@@ -0,0 +1,58 @@
+#include "frame_pacer.h"
+
+#include <SDL3/SDL_timer.h>
+#include <SDL3/SDL_atomic.h>
+
+#include <math.h>
+
+#include <tinydef.hpp>
+
+constexpr uint64_t MIN_SLACK_NS = 100 * 1000;
+constexpr uint64_t MAX_SLACK_NS = 4 * 1000 * 1000;
+
+void FramePacer::init(uint64_t frameNs) {
+	this->frameNs = frameNs;
+	slackNs = 2 * 1000 * 1000;    // start out careful, calibration brings this down after a few frames
+	deadline = SDL_GetTicksNS();
+	lateMean = 0.0;
+	lateVar = 0.0;
+}
+
+void FramePacer::wait() {
+	if (frameNs == 0) return;
+
+	// NOTE: deadlines are spaced from each other instead of from when wait gets called,
+	// so a frame that wakes up a little late doesn't push every frame after it back
+	deadline += frameNs;
+
+	uint64_t now = SDL_GetTicksNS();
+	if (now >= deadline) {
+		// we missed it by more than a whole frame (hitch, window drag...), start over from here instead of
+		// rushing out frames to catch up
+		if (now - deadline > frameNs) deadline = now;
+		return;
+	}
+
+	const uint64_t remaining = deadline - now;
+	if (remaining > slackNs) {
+		const uint64_t sleepNs = remaining - slackNs;
+		SDL_DelayNS(sleepNs);
+
+		const uint64_t woke = SDL_GetTicksNS();
+		_calibrate(static_cast<double>(woke - now) - static_cast<double>(sleepNs));
+	}
+
+	while (SDL_GetTicksNS() < deadline)
+		SDL_CPUPauseInstruction();
+}
+
+void FramePacer::_calibrate(double lateNs) {
+	// exponentially weighted, so the slack follows the timer if it gets better or worse (e.g. power saving kicks in)
+	const double d = lateNs - lateMean;
+	lateMean += d / 16.0;
+	lateVar += (d * d - lateVar) / 16.0;
+
+	// 3 standard deviations past the mean covers pretty much every sleep without spinning for ages
+	const double slack = lateMean + 3.0 * sqrt(lateVar);
+	slackNs = tim::clamp(static_cast<uint64_t>(tim::max(slack, 0.0)), MIN_SLACK_NS, MAX_SLACK_NS);
+}
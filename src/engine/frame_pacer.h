@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+// Waits out the rest of each frame so frames start exactly frameNs apart
+// SDL_DelayNS on its own regularly wakes up late (by up to a millisecond or more depending on the OS timer),
+// so we only sleep until a bit before the deadline and spin through the rest. How early we stop sleeping (slackNs)
+// is calibrated from how late the sleeps actually come back, so we don't spin any longer than we have to
+struct FramePacer {
+	uint64_t frameNs = 0;    // 0 means uncapped
+	uint64_t slackNs = 0;
+
+	void init(uint64_t frameNs);
+
+	// call once at the end of every frame
+	void wait();
+
+private:
+	uint64_t deadline = 0;
+
+	// running mean and variance of how late sleeps come back, in ns
+	double lateMean = 0.0;
+	double lateVar = 0.0;
+
+	void _calibrate(double lateNs);
+};
@@ -1,5 +1,6 @@
 #include "game_context.h"
 #include <simdjson.h>
+#include <mems.hpp>
 
 float GameContext::target_sec() const {
 	if (targetFps == 0) return 0.0f;
@@ -24,3 +25,17 @@ void GameContext::cleanup() {
 	delete jsonParser;
 	jsonParser = nullptr;
 }
+
+simdjson::padded_string_view GameContext::map_json(const char* path, mems::MappedFile& file, simdjson::padded_string& fallback) {
+	if (!mems::map_file(file, path)) {
+		fprintf(stderr, "Could not map json file %s\n", path);
+		return simdjson::padded_string_view();
+	}
+
+	if (file.slack >= simdjson::SIMDJSON_PADDING)
+		return simdjson::padded_string_view(static_cast<const char*>(file.data), file.size, file.size + file.slack);
+
+	fallback = simdjson::padded_string(static_cast<const char*>(file.data), file.size);
+	mems::unmap_file(file);
+	return fallback;
+}
\ No newline at end of file
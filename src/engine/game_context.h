@@ -4,32 +4,57 @@
 
 #include <stdint.h>
 
+namespace tds { template<typename T> struct Pool; }
+namespace mems {
+	struct Arena;
+	struct MappedFile;
+}
+namespace simdjson {
+	struct padded_string;
+	class padded_string_view;
+}
+
 struct GameContext {
+	// the game updates at a fixed TICK_RATE no matter how fast frames are drawn, so delta is always TICK_SEC
+	static constexpr uint64_t TICK_RATE = 60;
+	static constexpr float TICK_SEC = 1.0f / TICK_RATE;
+	static constexpr uint64_t TICK_NS = 1000000000ull / TICK_RATE;
+
 	float delta;
 	uint32_t points;
 
-	// we can fit another 4-byte value here
+	// how far the frame being drawn is between the last two updates (0 to 1),
+	// rendering interpolates between prevPos and pos with it so motion stays smooth above TICK_RATE
+	float alpha;
 
 	// NOTE(sand): I thought it might be a good idea for the gameobject logic to check this value and update
 	// only if it is not true, however it makes more sense to keep this outside of the gameobject logic and
 	// instead keep track of it as a part of the main game loop
 	// bool loading;
 
-	uint64_t targetFps;
+	uint64_t targetFps;    // frame cap, main sets this to the display's refresh rate
 	float target_sec() const;
 	uint64_t target_ns() const;
 
+	// Frame-scoped memory, owned by the main loop. frameArena gets cleared at the start of every frame,
+	// so anything that only needs to live until the frame is presented (render lists, query results, debug text)
+	// can just be pushed here without any cleanup. prevFrameArena is last frame's arena, which stays readable
+	// for one more frame, e.g. for diffing against last frame's results
+	struct mems::Arena* frameArena;
+	struct mems::Arena* prevFrameArena;
+
 	// engine details
 	struct SDL_Window* window;
 	const struct Gfx* gfx;
 	struct Input* input;
 	struct TextureAtlas* atlas;
 
-	// game details (eventually we might have pointers to enemies/bosses here)
-	int nEnemies;
+	// game details (eventually we might have pointers to bosses here)
 	struct GameWorld* world;
 	struct Player* player;
-	struct Enemy* enemies;
+	tds::Pool<struct Enemy>* enemies;
+	tds::Pool<struct Projectile>* playerProjectiles;
+	tds::Pool<struct Projectile>* enemyProjectiles;
 
 	// at the start of every frame, the game looks at which rooms the camera can see and which room the player
 	// is in and updates these with at max 4 of those rooms. It's fine to do this at the start of the frame
@@ -46,6 +71,12 @@ struct GameContext {
 	static void init();
 	static void cleanup();
 	static void* jsonParser;
+
+	// Maps a json file and returns a view of it that simdjson can parse in place
+	// simdjson reads up to SIMDJSON_PADDING bytes past the end of its input, which the mapping usually covers with the
+	// zeroed tail of its last page. Only when it doesn't is the file copied into fallback.
+	// file has to stay mapped (and fallback alive) for as long as the parsed document is used
+	static simdjson::padded_string_view map_json(const char* path, mems::MappedFile& file, simdjson::padded_string& fallback);
 };
 
 #define GET_JSON_PARSER reinterpret_cast<simdjson::ondemand::parser*>(GameContext::jsonParser)
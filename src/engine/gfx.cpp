@@ -1,3 +1,5 @@
+#define _CRT_SECURE_NO_WARNINGS
+
 #include "gfx.h"
 
 #include <SDL3/SDL.h>
@@ -5,8 +7,11 @@
 #include <math.h>
 
 #include <tinydef.hpp>
+#include <mems.hpp>
 
 #include "engine/image_asset.h"
+#include "engine/profiler.h"
+#include "engine/frame_capture.h"
 
 #pragma warning (disable : 4101)
 
@@ -44,8 +49,9 @@ Gfx::Gfx() {}
 //
 // If we really want to take it to the next level, we can instance a single unit quad, and
 // upload a minified struct of around 12 bytes per quad, which will bring this 21845 much higher.
-bool Gfx::init(SDL_Window* window) {
+bool Gfx::init(SDL_Window* window, Backend backend) {
 	windowPtr = window;
+	this->backend = backend;
 
 #ifndef USE_SDL_RENDERER
 	//
@@ -209,24 +215,70 @@ bool Gfx::init(SDL_Window* window) {
 	textureScreen1 = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, nesWidth, nesHeight);
 	SDL_SetTextureBlendMode(textureScreen1, SDL_BLENDMODE_BLEND_PREMULTIPLIED);
 	SDL_SetTextureScaleMode(textureScreen1, SDL_SCALEMODE_NEAREST);
+	mems::track_external("Gfx textureScreen1", nesWidth * nesHeight * 4);
+
+	vertices.init(MAX_BATCH_QUADS * 4, "Gfx vertices");
+	batches.init(MAX_BATCH_QUADS, "Gfx batches");
+	quadIndices.init(MAX_BATCH_QUADS * 6, "Gfx quad indices");
+	for (uint32_t i = 0; i < MAX_BATCH_QUADS; i++) {
+		const int v = static_cast<int>(i * 4);
+		quadIndices.push(v + 0);
+		quadIndices.push(v + 1);
+		quadIndices.push(v + 2);
+		quadIndices.push(v + 2);
+		quadIndices.push(v + 3);
+		quadIndices.push(v + 0);
+	}
+
+	if (backend == SOFTWARE) {
+		softRaster.init(nesWidth, nesHeight);
+		textureSoftware = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, nesWidth, nesHeight);
+		SDL_SetTextureScaleMode(textureSoftware, SDL_SCALEMODE_NEAREST);
+		kernels = SoftRaster::kernels_name(softRaster.kernels);
+	}
 
 #endif
 
+	cmds.init(MAX_CMDS, "Gfx commands");
+	palette.init(MAX_COLORS, "Gfx palette");
+	paletteArena.alloc(mems::Arena::DEFAULT_CAPACITY, "Gfx palette lookup");
+	paletteLookup.init(paletteArena, 64);
+
+	textGlyphs.init(MAX_TEXT_GLYPHS, "Gfx text glyphs");
+	textRuns.init(MAX_TEXT_RUNS, "Gfx text runs");
+	textArena.alloc(mems::Arena::DEFAULT_CAPACITY, "Gfx text lookup");
+	textLookup.init(textArena, MAX_TEXT_RUNS);
+
 	return true;
 }
 
 void Gfx::upload_atlas(const TextureAtlas& atlas) {
+	static_assert(MAX_ATLAS_PAGES == TextureAtlas::MAX_PAGES, "Gfx keeps a texture per atlas page");
+	static_assert(TextureAtlas::MAX_PAGES <= (0xFF >> RenderCmd::PAGE_SHIFT) + 1, "the page has to fit in RenderCmd::flags");
 	spriteAtlas = &atlas;
 
-	// for some reason each pixel is loaded with the endianness swapped
-	// maybe we're doing something wrong in the TextureAtlas image loading code?
-	// NOTE(sand): setting the pixelformat to ABGR instead of RGBA interprets the pixels properly
-	textureAtlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, atlas.width, atlas.height);
+	// cached glyphs point at the old atlas' font
+	_clear_text_cache();
+
+	// NOTE: the software backend reads the atlas straight from memory (see _flush_batches), it doesn't need any textures
+	if (backend == SOFTWARE) return;
+
+	for (int page = 0; page < MAX_ATLAS_PAGES; page++) {
+		if (textureAtlas[page]) SDL_DestroyTexture(textureAtlas[page]);
+		textureAtlas[page] = nullptr;
+		if (page >= atlas.nPages) continue;
 
-	SDL_UpdateTexture(textureAtlas, nullptr, atlas.data, atlas.width * TextureAtlas::NUM_CHANNELS);
+		// for some reason each pixel is loaded with the endianness swapped
+		// maybe we're doing something wrong in the TextureAtlas image loading code?
+		// NOTE(sand): setting the pixelformat to ABGR instead of RGBA interprets the pixels properly
+		textureAtlas[page] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, atlas.width, atlas.height);
 
-	SDL_SetTextureBlendMode(textureAtlas, SDL_BLENDMODE_BLEND_PREMULTIPLIED);
-	SDL_SetTextureScaleMode(textureAtlas, SDL_SCALEMODE_NEAREST);
+		SDL_UpdateTexture(textureAtlas[page], nullptr, atlas.page_data(page), atlas.width * TextureAtlas::NUM_CHANNELS);
+
+		SDL_SetTextureBlendMode(textureAtlas[page], SDL_BLENDMODE_BLEND_PREMULTIPLIED);
+		SDL_SetTextureScaleMode(textureAtlas[page], SDL_SCALEMODE_NEAREST);
+	}
+	mems::track_external("Gfx textureAtlas", static_cast<uint64_t>(atlas.page_bytes()) * atlas.nPages);
 }
 
 void Gfx::cleanup() {
@@ -257,18 +309,48 @@ void Gfx::cleanup() {
 	//
 	// SDL Renderer
 	//
-	SDL_DestroyTexture(textureAtlas);
+	for (SDL_Texture* texture : textureAtlas) {
+		if (texture) SDL_DestroyTexture(texture);
+	}
 	SDL_DestroyTexture(textureScreen1);
+	if (backend == SOFTWARE) {
+		SDL_DestroyTexture(textureSoftware);
+		softRaster.cleanup();
+	}
 	SDL_DestroyRenderer(renderer);
+	vertices.release();
+	batches.release();
+	quadIndices.release();
+	mems::track_external("Gfx textureAtlas", 0);
+	mems::track_external("Gfx textureScreen1", 0);
 #endif
+
+	cmds.release();
+	palette.release();
+	paletteArena.dealloc();
+	textGlyphs.release();
+	textRuns.release();
+	textArena.dealloc();
 }
 
 void Gfx::begin_frame() {
 	assert(spriteAtlas != nullptr);
 	assert(fontIdx != UINT32_MAX);
 
+	// the last frame's commands were kept around for dump_frame until now
+	cmds.clear();
+	palette.clear();
+	paletteLookup.clear();
+	lastColorIdx = UINT16_MAX;
+	layer = LAYER_WORLD;
+
 #ifndef USE_SDL_RENDERER
 #else
+	if (backend == SOFTWARE) {
+		softRaster.clear(clearColor);
+		return;
+	}
+
 	SDL_SetRenderTarget(renderer, textureScreen1);
 	SDL_SetRenderDrawColorFloat(renderer, EXPAND_COL(clearColor));
 	SDL_RenderClear(renderer);
@@ -276,6 +358,7 @@ void Gfx::begin_frame() {
 }
 
 void Gfx::finish_frame() {
+	PROFILE_ZONE("finish_frame");
 #ifndef USE_SDL_RENDERER
 	//
 	// SDL GPU
@@ -310,6 +393,19 @@ void Gfx::finish_frame() {
 	SDL_SubmitGPUCommandBuffer(commandBuffer);
 
 #else
+	// everything queued this frame still has to go to the nes target
+	{
+		PROFILE_ZONE("draw commands");
+		capturingQuads = backend == HARDWARE && capture && capture->is_recording() && capture->acquire_quads(*spriteAtlas, clearColor);
+		_execute_commands();
+		_flush_batches();
+	}
+	frameStats.commands = cmds.size;
+	lastFrameStats = frameStats;
+	frameStats = {};
+
+	if (capture && capture->is_recording()) _capture_frame();
+
 	int width = -1, height = -1;
 	SDL_GetWindowSize(windowPtr, &width, &height);
 
@@ -333,66 +429,182 @@ void Gfx::finish_frame() {
 		dest.x = (static_cast<float>(width) - dest.w) / 2.0f;
 	}
 
-	SDL_RenderTexture(renderer, textureScreen1, nullptr, &dest);
-	SDL_RenderPresent(renderer);
+	if (backend == SOFTWARE) {
+		// the whole frame is a single texture upload
+		SDL_UpdateTexture(textureSoftware, nullptr, softRaster.pixels, nesWidth * sizeof(uint32_t));
+		SDL_RenderTexture(renderer, textureSoftware, nullptr, &dest);
+	} else {
+		SDL_RenderTexture(renderer, textureScreen1, nullptr, &dest);
+	}
+	{
+		PROFILE_ZONE("present");
+		SDL_RenderPresent(renderer);
+	}
 
 #endif
 
 }
 
 void Gfx::queue_point(SDL_FPoint pt, bool useCamera, const SDL_FColor& color) {
-#ifndef USE_SDL_RENDERER
-#else
 	if (useCamera) {
 		pt.x -= cameraPos.x;
 		pt.y -= cameraPos.y;
 	}
-	SDL_SetRenderDrawColorFloat(renderer, EXPAND_COL(color));
-	SDL_RenderPoint(renderer, pt.x, pt.y);
-#endif
+	// a point is just a 1x1 untextured quad
+	_record(floorf(pt.x), floorf(pt.y), 1.0f, 1.0f, 0, 0, color, 0);
 }
 
 void Gfx::queue_rect(SDL_FRect dest, bool useCamera, const SDL_FColor& color) {
-#ifndef USE_SDL_RENDERER
-#else
 	if (useCamera) {
 		dest.x -= cameraPos.x;
 		dest.y -= cameraPos.y;
 	}
-	SDL_SetRenderDrawColorFloat(renderer, EXPAND_COL(color));
-	SDL_RenderFillRect(renderer, &dest);
-#endif
+	_record(dest.x, dest.y, dest.w, dest.h, 0, 0, color, 0);
+}
+
+// NOTE: a 64 bit hash is treated as unique, two different strings colliding would just draw the wrong text
+static uint64_t text_key(const char* text, size_t len, int x, int y, uint32_t colorKey) {
+	const uint64_t pos = (static_cast<uint64_t>(static_cast<uint16_t>(x)) << 16) | static_cast<uint16_t>(y);
+	return tds::fnv1a(text, len) ^ tds::mix64((pos << 32) | colorKey);
+}
+
+static SDL_Rect glyph_src(char c, const SubTexture& font) {
+	const int unrolled = (c - 32) * 8;
+	return SDL_Rect{ unrolled % font.width, (unrolled / font.width) * 8, 8, 8 };
 }
 
 void Gfx::queue_text(int x, int y, const char* text, const SDL_FColor& color) {
+	const size_t len = strlen(text);
+	const uint64_t key = text_key(text, len, x, y, SoftRaster::pack_color(color));
+	if (const uint32_t* runIdx = textLookup.find(key)) {
+		_queue_text_run(textRuns[*runIdx], color);
+		return;
+	}
+
+	// first time we see this text: record it glyph by glyph like any other sprites, then keep the commands
+	const uint32_t firstCmd = cmds.size;
+	_layout_text(x, y, text, len, color);
+	_cache_text_run(key, firstCmd, 0, 0);
+}
+
+void Gfx::queue_counter(int x, int y, const char* label, int value, const SDL_FColor& color) {
+	const size_t labelLen = strlen(label);
+	assert(memchr(label, '\n', labelLen) == nullptr);
+
+	// same as %d, but without going through printf every frame
+	char digits[12];
+	int nDigits = 0;
+	{
+		char reversed[12];
+		uint32_t v = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+		int n = 0;
+		do {
+			reversed[n++] = static_cast<char>('0' + v % 10);
+			v /= 10;
+		} while (v);
+		if (value < 0) digits[nDigits++] = '-';
+		while (n) digits[nDigits++] = reversed[--n];
+	}
+
+	// NOTE: salted so a counter never shares a run with a queue_text of just its label
+	const uint64_t key = text_key(label, labelLen, x, y, SoftRaster::pack_color(color)) ^ 0x636f756e746572ull;
+	const uint32_t* runIdx = textLookup.find(key);
+	if (runIdx) {
+		TextRun& run = textRuns[*runIdx];
+		if (run.value != value) {
+			if (run.nGlyphs == labelLen + nDigits) {
+				// same length and nothing got culled, so glyph i of the run is still character i
+				// the label and the glyph positions stay as they are, only the digits' source rects get swapped
+				const SubTexture& font = spriteAtlas->subTextures[fontIdx];
+				for (int i = 0; i < nDigits; i++) {
+					RenderCmd& glyph = textGlyphs[run.firstGlyph + static_cast<uint32_t>(labelLen) + i];
+					const SDL_Rect src = glyph_src(digits[i], font);
+					glyph.srcX = static_cast<uint16_t>(font.x + src.x);
+					glyph.srcY = static_cast<uint16_t>(font.y + src.y);
+				}
+			} else {
+				const uint32_t firstCmd = cmds.size;
+				_layout_text(x, y, label, labelLen, color);
+				_layout_text(x + static_cast<int>(labelLen) * 8, y, digits, nDigits, color);
+				run.value = value;
+				_store_text_run(run, firstCmd);
+				return;
+			}
+			run.value = value;
+		}
+		_queue_text_run(run, color);
+		return;
+	}
+
+	const uint32_t firstCmd = cmds.size;
+	_layout_text(x, y, label, labelLen, color);
+	_layout_text(x + static_cast<int>(labelLen) * 8, y, digits, nDigits, color);
+	_cache_text_run(key, firstCmd, static_cast<uint32_t>(labelLen) + sizeof(digits) - 1, value);
+}
+
+void Gfx::_layout_text(int x, int y, const char* text, size_t len, const SDL_FColor& color) {
 	const SubTexture& fontSubtex = spriteAtlas->subTextures[fontIdx];
-	size_t len = strlen(text);
 
 	int px = x, py = y;
-	for (int i = 0; i < len; i++) {
+	for (size_t i = 0; i < len; i++) {
 		switch (text[i]) {
 		case '\n':
 			px = x;
 			py += 8;
 			break;
 		default:
-			int unrolled = (text[i] - 32) * 8;
-			SDL_Rect src = {
-				unrolled % fontSubtex.width,
-				(unrolled / fontSubtex.width) * 8,
-				8,
-				8
-			};
-			queue_sprite(px, py, fontSubtex, src, false, color);
+			queue_sprite(px, py, fontSubtex, glyph_src(text[i], fontSubtex), false, color);
 			px += 8;
 		}
 	}
 }
 
-void Gfx::queue_sprite(int x, int y, const SubTexture& subTex, const SDL_Rect& src, bool useCamera, const SDL_FColor& color, bool flipH, bool flipV) {
-	SDL_SetTextureColorModFloat(textureAtlas, color.r, color.g, color.b);
-	SDL_SetTextureAlphaModFloat(textureAtlas, color.a);
+// copies the commands recorded since firstCmd into the run, which has to have room for them
+void Gfx::_store_text_run(TextRun& run, uint32_t firstCmd) {
+	run.nGlyphs = cmds.size - firstCmd;
+	assert(run.nGlyphs <= run.capacity);
+	if (run.nGlyphs == 0) return;
+	memcpy(&textGlyphs[run.firstGlyph], &cmds[firstCmd], sizeof(RenderCmd) * run.nGlyphs);
+}
+
+uint32_t Gfx::_cache_text_run(uint64_t key, uint32_t firstCmd, uint32_t capacity, int value) {
+	capacity = tim::max(capacity, cmds.size - firstCmd);
+	if (capacity == 0 || capacity > textGlyphs.capacity) return UINT32_MAX;
 
+	// NOTE: when the cache fills up it's just thrown away, whatever is still on screen gets laid out again next frame
+	if (textRuns.size >= textRuns.capacity || textGlyphs.size + capacity > textGlyphs.capacity)
+		_clear_text_cache();
+
+	const uint32_t runIdx = textRuns.size;
+	TextRun& run = textRuns.push(TextRun{ textGlyphs.size, 0, capacity, value });
+	for (uint32_t i = 0; i < capacity; i++) textGlyphs.push(RenderCmd{});
+	_store_text_run(run, firstCmd);
+
+	textLookup.put(key, runIdx);
+	return runIdx;
+}
+
+void Gfx::_queue_text_run(const TextRun& run, const SDL_FColor& color) {
+	if (cmds.size + run.nGlyphs > MAX_CMDS) {
+		fprintf(stderr, "Gfx ran out of space for commands this frame!\n");
+		return;
+	}
+
+	const uint16_t colorIdx = _intern_color(color);
+	for (uint32_t i = 0; i < run.nGlyphs; i++) {
+		RenderCmd& cmd = cmds.push(textGlyphs[run.firstGlyph + i]);
+		cmd.color = colorIdx;
+		cmd.layer = layer;
+	}
+}
+
+void Gfx::_clear_text_cache() {
+	textGlyphs.clear();
+	textRuns.clear();
+	textLookup.clear();
+}
+
+void Gfx::queue_sprite(int x, int y, const SubTexture& subTex, const SDL_Rect& src, bool useCamera, const SDL_FColor& color, bool flipH, bool flipV) {
 	SDL_FRect dest = {
 		static_cast<float>(x),
 		static_cast<float>(y),
@@ -400,18 +612,13 @@ void Gfx::queue_sprite(int x, int y, const SubTexture& subTex, const SDL_Rect& s
 		static_cast<float>(src.h)
 	};
 
-	SDL_FRect fSrc;
-	SDL_RectToFRect(&src, &fSrc);
-	fSrc.x += subTex.x;
-	fSrc.y += subTex.y;
-
 	if (useCamera) {
 		dest.x -= cameraPos.x;
 		dest.y -= cameraPos.y;
 	}
 
-	SDL_FlipMode flipMode = static_cast<SDL_FlipMode>((flipH ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE) | (flipV ? SDL_FLIP_VERTICAL : SDL_FLIP_NONE));
-	SDL_RenderTextureRotated(renderer, textureAtlas, &fSrc, &dest, 0.0, nullptr, flipMode);
+	const uint8_t flags = RenderCmd::TEXTURED | (flipH ? RenderCmd::FLIP_H : 0) | (flipV ? RenderCmd::FLIP_V : 0) | (subTex.page << RenderCmd::PAGE_SHIFT);
+	_record(dest.x, dest.y, dest.w, dest.h, subTex.x + src.x, subTex.y + src.y, color, flags);
 }
 
 
@@ -422,6 +629,323 @@ void Gfx::queue_sprite(int x, int y, uint32_t spriteIdx, const SDL_Rect& src, bo
 	queue_sprite(x, y, spriteAtlas->subTextures[spriteIdx], src, useCamera, color, flipH, flipV);
 }
 
+void Gfx::queue_sprite_palette(int x, int y, uint32_t spriteIdx, uint16_t atlasPalette, const SDL_Rect& src, bool useCamera, bool flipH, bool flipV) {
+	if (spriteIdx == TextureAtlas::INVALID_IDX)
+		return;
+
+	// without an indexed atlas there are no palettes to pick from
+	if (atlasPalette >= spriteAtlas->palettes.size) {
+		queue_sprite(x, y, spriteIdx, src, useCamera, SDL_FColor{ 1.0f, 1.0f, 1.0f, 1.0f }, flipH, flipV);
+		return;
+	}
+
+	const SubTexture& subTex = spriteAtlas->subTextures[spriteIdx];
+	SDL_FRect dest = { static_cast<float>(x), static_cast<float>(y), static_cast<float>(src.w), static_cast<float>(src.h) };
+	if (useCamera) {
+		dest.x -= cameraPos.x;
+		dest.y -= cameraPos.y;
+	}
+
+	const uint8_t flags = RenderCmd::TEXTURED | RenderCmd::PALETTE | (flipH ? RenderCmd::FLIP_H : 0) | (flipV ? RenderCmd::FLIP_V : 0) | (subTex.page << RenderCmd::PAGE_SHIFT);
+	_record(dest.x, dest.y, dest.w, dest.h, subTex.x + src.x, subTex.y + src.y, SDL_FColor{}, flags, atlasPalette);
+}
+
+uint16_t Gfx::_intern_color(const SDL_FColor& color) {
+	const uint32_t key = SoftRaster::pack_color(color);
+	if (key == lastColorKey && lastColorIdx != UINT16_MAX)
+		return lastColorIdx;
+
+	uint16_t idx;
+	if (const uint16_t* found = paletteLookup.find(key)) {
+		idx = *found;
+	} else if (palette.size < MAX_COLORS) {
+		idx = static_cast<uint16_t>(palette.size);
+		palette.push(color);
+		paletteLookup.put(key, idx);
+	} else {
+		fprintf(stderr, "Gfx ran out of palette entries this frame!\n");
+		idx = 0;
+	}
+
+	lastColorKey = key;
+	lastColorIdx = idx;
+	return idx;
+}
+
+void Gfx::_record(float x, float y, float w, float h, int srcX, int srcY, const SDL_FColor& color, uint8_t flags, uint16_t atlasPalette) {
+	// snap to pixels the same way the rasterizer would cover them (a pixel is drawn when its center is inside),
+	// for unscaled sprites this picks the exact same texels as drawing at the fractional position
+	const int x0 = static_cast<int>(ceilf(x - 0.5f));
+	const int y0 = static_cast<int>(ceilf(y - 0.5f));
+	const int x1 = static_cast<int>(ceilf(x + w - 0.5f));
+	const int y1 = static_cast<int>(ceilf(y + h - 0.5f));
+
+	// nothing of it is on screen, so don't even record it
+	if (x0 >= x1 || y0 >= y1 || x1 <= 0 || y1 <= 0 || x0 >= nesWidth || y0 >= nesHeight)
+		return;
+
+	if (cmds.size >= MAX_CMDS) {
+		fprintf(stderr, "Gfx ran out of space for commands this frame!\n");
+		return;
+	}
+
+	assert(x0 >= INT16_MIN && y0 >= INT16_MIN && x1 - x0 <= UINT16_MAX && y1 - y0 <= UINT16_MAX);
+	assert(layer <= LAYER_HUD);
+	cmds.push(RenderCmd{
+		static_cast<int16_t>(x0), static_cast<int16_t>(y0),
+		static_cast<uint16_t>(x1 - x0), static_cast<uint16_t>(y1 - y0),
+		static_cast<uint16_t>(srcX), static_cast<uint16_t>(srcY),
+		atlasPalette != NO_PALETTE ? atlasPalette : _intern_color(color), flags, layer
+	});
+}
+
+// NOTE: the file is just a header, the palette and then the commands, all written as they are in memory
+struct RenderCmdFileHeader {
+	static constexpr uint32_t MAGIC = 0x43584647;    // "GFXC"
+	// 2: the top 4 bits of RenderCmd::flags are the atlas page, PALETTE commands hold an atlas palette index in color
+	static constexpr uint32_t VERSION = 2;
+
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nCmds;
+	uint32_t nColors;
+	int32_t atlasWidth, atlasHeight;
+};
+
+bool Gfx::dump_frame(const char* path) const {
+	::FILE* fp = fopen(path, "wb");
+	if (!fp) {
+		fprintf(stderr, "Could not open %s to dump the frame!\n", path);
+		return false;
+	}
+
+	const RenderCmdFileHeader header = {
+		RenderCmdFileHeader::MAGIC, RenderCmdFileHeader::VERSION,
+		cmds.size, palette.size,
+		spriteAtlas ? spriteAtlas->width : 0, spriteAtlas ? spriteAtlas->height : 0
+	};
+	bool ok = 1 == fwrite(&header, sizeof(header), 1, fp);
+	ok = ok && palette.size == fwrite(palette.data, sizeof(SDL_FColor), palette.size, fp);
+	ok = ok && cmds.size == fwrite(cmds.data, sizeof(RenderCmd), cmds.size, fp);
+	fclose(fp);
+
+	if (!ok) fprintf(stderr, "Could not write the frame to %s!\n", path);
+	return ok;
+}
+
+bool Gfx::load_frame(const char* path, mems::Arena& arena, RenderCmdStream& stream) {
+	size_t size = 0;
+	const uint8_t* data = static_cast<const uint8_t*>(mems::load_file(arena, path, size));
+	if (!data) {
+		fprintf(stderr, "Could not load frame %s!\n", path);
+		return false;
+	}
+
+	RenderCmdFileHeader header;
+	if (size < sizeof(header)) {
+		fprintf(stderr, "%s is too small to be a frame!\n", path);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	const size_t expected = sizeof(header) + sizeof(SDL_FColor) * header.nColors + sizeof(RenderCmd) * header.nCmds;
+	if (header.magic != RenderCmdFileHeader::MAGIC || header.version != RenderCmdFileHeader::VERSION || size < expected) {
+		fprintf(stderr, "%s is not a frame this version can read!\n", path);
+		return false;
+	}
+
+	stream.nCmds = header.nCmds;
+	stream.nColors = header.nColors;
+	stream.atlasWidth = header.atlasWidth;
+	stream.atlasHeight = header.atlasHeight;
+	stream.colors = reinterpret_cast<const SDL_FColor*>(data + sizeof(header));
+	stream.cmds = reinterpret_cast<const RenderCmd*>(data + sizeof(header) + sizeof(SDL_FColor) * header.nColors);
+	return true;
+}
+
+void Gfx::queue_frame(const RenderCmdStream& stream) {
+	if (spriteAtlas && (stream.atlasWidth != spriteAtlas->width || stream.atlasHeight != spriteAtlas->height))
+		fprintf(stderr, "Replaying a frame recorded with a %dx%d atlas, it'll probably look wrong!\n", stream.atlasWidth, stream.atlasHeight);
+
+	mems::Arena& scratch = mems::get_scratch();
+	mems::ArenaScope scope(scratch);
+
+	// the recorded palette indices have to be moved over to this frame's palette
+	uint16_t* remap = static_cast<uint16_t*>(scratch.push_aligned(sizeof(uint16_t) * stream.nColors, alignof(uint16_t)));
+	for (uint32_t i = 0; i < stream.nColors; i++)
+		remap[i] = _intern_color(stream.colors[i]);
+
+	// NOTE: the page is only 4 bits of the flags, so a dump from another atlas (or a broken one) can point at a page
+	// that isn't there, and that would index past textureAtlas/the page memory. Those commands just get dropped
+	uint32_t nDropped = 0;
+	for (uint32_t i = 0; i < stream.nCmds && cmds.size < MAX_CMDS; i++) {
+		RenderCmd cmd = stream.cmds[i];
+		if ((cmd.flags & RenderCmd::TEXTURED) && (!spriteAtlas || cmd.page() >= spriteAtlas->nPages)) {
+			nDropped++;
+			continue;
+		}
+		if (!(cmd.flags & RenderCmd::TEXTURED)) cmd.flags &= ~RenderCmd::PALETTE;    // untextured quads always use the frame's palette
+		if (!(cmd.flags & RenderCmd::PALETTE))
+			cmd.color = cmd.color < stream.nColors ? remap[cmd.color] : 0;
+		// atlas palettes aren't in the dump, so one that this atlas doesn't have falls back to its own colors
+		// (anything past 255 would also spill into the page bits of the sort key)
+		else if (!spriteAtlas || cmd.color >= spriteAtlas->palettes.size)
+			cmd.color = TextureAtlas::BASE_PALETTE;
+		if (cmd.layer > LAYER_HUD) cmd.layer = LAYER_HUD;    // the sort key only has room for the layers there are
+		cmds.push(cmd);
+	}
+	// the same frame gets queued over and over while replaying, so only say it once
+	static bool warnedDropped = false;
+	if (nDropped > 0 && !warnedDropped) {
+		fprintf(stderr, "Dropped %u replayed commands on atlas pages that don't exist\n", nDropped);
+		warnedDropped = true;
+	}
+}
+
+#ifdef USE_SDL_RENDERER
+// Sorts the recorded commands by layer, depth and texture, and turns them into quads
+// the sort is stable, so commands with the same key stay in the order they were queued
+void Gfx::_execute_commands() {
+	if (cmds.size == 0) return;
+
+	mems::Arena& scratch = mems::get_scratch();
+	mems::ArenaScope scope(scratch);
+
+	// NOTE: one 64 bit key per command: layer (2 bits) | depth (9) | texture (13) in bits 24..47, the command index in the bottom 24
+	// that's only 3 bytes (or 2 passes of 12 bits) to sort on, and since the sort is stable, equal keys stay in queue order
+	static_assert(MAX_CMDS <= 1u << 24, "command indices have to fit below the texture in the sort key");
+	static_assert(LAYER_HUD < 1 << 2, "the layer has to fit in the sort key");
+	static_assert(TextureAtlas::MAX_PALETTES <= 1u << 8, "the palette has to fit below the page in the sort key");
+	static_assert(1 + (((TextureAtlas::MAX_PAGES - 1) << 8) | 0xFF) < 1 << 13, "the page and palette have to fit in the sort key");
+	const uint32_t n = cmds.size;
+	uint64_t* keys = static_cast<uint64_t*>(scratch.push_aligned(sizeof(uint64_t) * n, alignof(uint64_t)));
+	uint64_t* tmp = static_cast<uint64_t*>(scratch.push_aligned(sizeof(uint64_t) * n, alignof(uint64_t)));
+	for (uint32_t i = 0; i < n; i++) {
+		const RenderCmd& cmd = cmds[i];
+		// anything that reaches past 511 is off the bottom of the screen anyway, so those just keep queue order between them
+		const uint64_t depth = (ySortedLayers >> cmd.layer) & 1 ? static_cast<uint64_t>(tim::clamp(cmd.y + cmd.h, 0, 511)) : 0;
+		// 0 is untextured, 1 + (page, palette) is the atlas, so sprites on the same page with the same palette swap end up in the same batch
+		const uint64_t palette = cmd.flags & RenderCmd::PALETTE ? cmd.color : TextureAtlas::BASE_PALETTE;
+		const uint64_t texture = cmd.flags & RenderCmd::TEXTURED ? 1 + ((static_cast<uint64_t>(cmd.page()) << 8) | palette) : 0;
+		keys[i] = (static_cast<uint64_t>(cmd.layer) << 46) | (depth << 37) | (texture << 24) | i;
+	}
+	const uint64_t sortStart = SDL_GetTicksNS();
+	// NOTE: clearing and summing the 12 bit histograms is a fixed ~6us, so below a few thousand commands 3 byte passes are faster
+	static constexpr uint32_t WIDE_DIGIT_SORT_CMDS = 3000;
+	keys = n < WIDE_DIGIT_SORT_CMDS ? tds::radix_sort(keys, tmp, n, 3, 6) : tds::radix_sort_12(keys, tmp, n, 24, 48);
+	frameStats.sortNs = SDL_GetTicksNS() - sortStart;
+
+	const float invW = 1.0f / static_cast<float>(spriteAtlas->width);
+	const float invH = 1.0f / static_cast<float>(spriteAtlas->height);
+
+	// only the software backend can swap palettes at draw time
+	const bool indexed = backend == SOFTWARE && spriteAtlas->indexedData != nullptr;
+
+	for (uint32_t i = 0; i < n; i++) {
+		const RenderCmd& cmd = cmds[static_cast<uint32_t>(keys[i] & 0xFFFFFF)];
+		const SDL_FRect dest = {
+			static_cast<float>(cmd.x), static_cast<float>(cmd.y),
+			static_cast<float>(cmd.w), static_cast<float>(cmd.h)
+		};
+
+		if (!(cmd.flags & RenderCmd::TEXTURED)) {
+			_push_quad(-1, nullptr, dest, 0.0f, 0.0f, 0.0f, 0.0f, palette[cmd.color]);
+			continue;
+		}
+
+		SDL_FColor color;
+		const uint32_t* atlasPalette = nullptr;
+		if (cmd.flags & RenderCmd::PALETTE) {
+			const TextureAtlas::Palette& swap = spriteAtlas->palettes[cmd.color];
+			color = indexed ? SDL_FColor{ 1.0f, 1.0f, 1.0f, 1.0f } : swap.tint;
+			if (indexed) atlasPalette = swap.colors;
+			// NOTE: without the indexed atlas a swap draws with the base colors, so at least don't do that quietly
+			static bool warnedSwap = false;
+			if (!indexed && !swap.tintOnly && !warnedSwap) {
+				fprintf(stderr, "Palette %u is a color swap, this backend can only draw palette tints so it draws the base colors\n", cmd.color);
+				warnedSwap = true;
+			}
+		} else {
+			color = palette[cmd.color];
+			if (indexed) atlasPalette = spriteAtlas->palettes[TextureAtlas::BASE_PALETTE].colors;
+		}
+
+		// SDL_RenderGeometry wants normalized texture coords
+		float u0 = static_cast<float>(cmd.srcX) * invW;
+		float v0 = static_cast<float>(cmd.srcY) * invH;
+		float u1 = static_cast<float>(cmd.srcX + cmd.w) * invW;
+		float v1 = static_cast<float>(cmd.srcY + cmd.h) * invH;
+
+		// flipping is just swapping the texture coords
+		if (cmd.flags & RenderCmd::FLIP_H) { const float u = u0; u0 = u1; u1 = u; }
+		if (cmd.flags & RenderCmd::FLIP_V) { const float v = v0; v0 = v1; v1 = v; }
+
+		_push_quad(cmd.page(), atlasPalette, dest, u0, v0, u1, v1, color);
+	}
+}
+
+void Gfx::_push_quad(int page, const uint32_t* atlasPalette, const SDL_FRect& dest, float u0, float v0, float u1, float v1, const SDL_FColor& color) {
+	if (vertices.size >= MAX_BATCH_QUADS * 4)
+		_flush_batches();
+
+	const uint32_t quadIdx = vertices.size / 4;
+	if (batches.size == 0 || batches[batches.size - 1].page != page || batches[batches.size - 1].palette != atlasPalette)
+		batches.push(DrawBatch{ page < 0 ? nullptr : textureAtlas[page], atlasPalette, page, quadIdx, 0 });
+	batches[batches.size - 1].nQuads++;
+
+	// wound the same way as quadIndices: top left, top right, bottom right, bottom left
+	const float x0 = dest.x, y0 = dest.y;
+	const float x1 = dest.x + dest.w, y1 = dest.y + dest.h;
+	vertices.push(SDL_Vertex{ { x0, y0 }, color, { u0, v0 } });
+	vertices.push(SDL_Vertex{ { x1, y0 }, color, { u1, v0 } });
+	vertices.push(SDL_Vertex{ { x1, y1 }, color, { u1, v1 } });
+	vertices.push(SDL_Vertex{ { x0, y1 }, color, { u0, v1 } });
+}
+
+void Gfx::_flush_batches() {
+	for (const DrawBatch& batch : batches) {
+		if (backend == SOFTWARE) {
+			// the indexed atlas when there is one, a byte per texel instead of 4
+			if (batch.page >= 0) {
+				const int w = spriteAtlas->width, h = spriteAtlas->height;
+				if (spriteAtlas->indexedData) softRaster.set_indexed_texture(spriteAtlas->indexedData + static_cast<size_t>(w) * h * batch.page, w, h);
+				else softRaster.set_texture(spriteAtlas->page_data(batch.page), w, h);
+			}
+			softRaster.draw_quads(vertices.data + batch.firstQuad * 4, batch.nQuads, batch.page >= 0, batch.palette);
+			continue;
+		}
+
+		if (capturingQuads) capture->add_quads(vertices.data + batch.firstQuad * 4, batch.nQuads, batch.page, batch.palette);
+		SDL_RenderGeometry(renderer, batch.texture,
+			vertices.data + batch.firstQuad * 4, static_cast<int>(batch.nQuads * 4),
+			quadIndices.data, static_cast<int>(batch.nQuads * 6));
+		frameStats.drawCalls++;
+	}
+
+	frameStats.quads += vertices.size / 4;
+	vertices.clear();
+	batches.clear();
+}
+
+void Gfx::_capture_frame() {
+	PROFILE_ZONE("capture");
+
+	// NOTE: SDL_Renderer has no async readback, so the hardware backend doesn't read its pixels back at all.
+	// its quads already went to the capture in _flush_batches, and the writer thread draws them with a SoftRaster
+	if (backend == HARDWARE) {
+		if (capturingQuads) capture->submit_quads();
+		capturingQuads = false;
+		return;
+	}
+
+	uint32_t* pixels = capture->acquire();
+	if (!pixels) return;    // the writer is behind, this frame gets dropped
+
+	memcpy(pixels, softRaster.pixels, sizeof(uint32_t) * nesWidth * nesHeight);
+	capture->submit(pixels);
+}
+#endif
+
 /*
 void Gfx::queue_rect(const SDL_FRect& dest, const SDL_FRect& src, const SDL_Color& color) {
 	SDL_SetTextureColorModFloat(textureAtlas, color.r, color.g, color.b);
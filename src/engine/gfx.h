@@ -3,34 +3,110 @@
 #include <SDL3/SDL_gpu.h>
 #include <SDL3/SDL_render.h>
 
+#include <tinydef.hpp>
+
+#include "engine/soft_raster.h"
+
 #define USE_SDL_RENDERER
 
 #define EXPAND_COL(col) col.r, col.g, col.b, col.a
 
 struct TextureAtlas;
 struct SubTexture;
+struct FrameCapture;
+
+// Every queue_* call records one of these (queue_text records one per glyph), and finish_frame sorts and draws them.
+// Positions are already snapped to nes screen pixels with the camera applied, so a recorded frame
+// can be dumped and drawn again later without the game running (see Gfx::dump_frame)
+struct RenderCmd {
+	enum Flags : uint8_t {
+		TEXTURED = 1 << 0,
+		FLIP_H = 1 << 1,
+		FLIP_V = 1 << 2,
+		PALETTE = 1 << 3,    // color is an atlas palette (TextureAtlas::palettes) instead of a color from the frame's palette
+	};
+	// the top 4 bits of flags are the atlas page the source rect is in (SubTexture::page)
+	static constexpr int PAGE_SHIFT = 4;
+	uint8_t page() const { return flags >> PAGE_SHIFT; }
+
+	int16_t x, y;           // top left on screen
+	uint16_t w, h;
+	uint16_t srcX, srcY;    // top left texel of the source rect in its atlas page, if TEXTURED
+	uint16_t color;         // index into the frame's color palette
+	uint8_t flags;
+	uint8_t layer;          // see Gfx::Layer
+};
+static_assert(sizeof(RenderCmd) == 16, "RenderCmd should stay small, there are thousands of them per frame");
+
+// A frame loaded with Gfx::load_frame, it points into the arena it was loaded with
+struct RenderCmdStream {
+	uint32_t nCmds;
+	uint32_t nColors;
+	int atlasWidth, atlasHeight;    // page size, the frame is only meaningful with the atlas it was recorded with
+	const RenderCmd* cmds;
+	const SDL_FColor* colors;
+};
 
 struct Gfx {
 	static constexpr int nesWidth = 256, nesHeight = 240;
+
+	// how the queued quads get turned into pixels, picked at init
+	enum Backend {
+		HARDWARE,    // SDL_RenderGeometry
+		SOFTWARE,    // SoftRaster on the cpu, for machines without a gpu. SDL_Renderer is only used to present
+	};
+
+	// commands are drawn by layer first, so things can be queued in any order
+	// inside a layer they're drawn by depth and then by texture, ties keep the order they were queued in
+	enum Layer : uint8_t {
+		LAYER_WORLD,
+		LAYER_ENTITIES,
+		LAYER_HUD,
+	};
+	uint8_t layer = LAYER_WORLD;    // the layer queue_* records into, begin_frame resets it
+
+	// layers in this mask get their depth from the bottom edge of each command, so things lower on screen
+	// draw over things behind them. every other layer just keeps queue order
+	uint32_t ySortedLayers = 1u << LAYER_ENTITIES;
+
 	SDL_FColor clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
 	SDL_FPoint cameraPos = { 0, 0 };
 	uint32_t fontIdx = UINT32_MAX;
 
+	struct FrameStats {
+		uint32_t commands;
+		uint32_t drawCalls;
+		uint32_t quads;
+		uint64_t sortNs;    // sorting the commands in _execute_commands
+	};
+	FrameStats lastFrameStats = {};    // filled in by finish_frame
+	const char* kernels = "none";    // the blend kernels the software backend picked in init (SoftRaster::kernels_name)
+	FrameCapture* capture = nullptr;    // when this is recording, finish_frame hands it a copy of every frame
+
 	Gfx();
 
-	bool init(SDL_Window*);
+	bool init(SDL_Window*, Backend backend = HARDWARE);
 	void upload_atlas(const TextureAtlas& atlas);
 	void cleanup();
 
 	void queue_point(SDL_FPoint pt, bool useCamera = true, const SDL_FColor& color = { 1.0f, 1.0f, 1.0f, 1.0f });
 	void queue_rect(SDL_FRect dest, bool useCamera = true, const SDL_FColor& color = { 1.0f, 1.0f, 1.0f, 1.0f });
 	// always draws text @ font height 8
+	// the glyphs are laid out once per (text, position, color) and reused while that text keeps getting queued
 	void queue_text(int x, int y, const char* text, const SDL_FColor& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+	// label followed by value, for HUD counters. label can't have newlines in it
+	// cached like queue_text, but when value changes only the glyphs of the digits that changed get rewritten
+	void queue_counter(int x, int y, const char* label, int value, const SDL_FColor& color = { 1.0f, 1.0f, 1.0f, 1.0f });
 
 	void queue_sprite(int x, int y, uint32_t spriteIdx, const SDL_Rect& src,
 		bool useCamera = true, const SDL_FColor& color = { 1.0f, 1.0f, 1.0f, 1.0f }, bool flipH = false, bool flipV = false);
 	void queue_sprite(int x, int y, const SubTexture& subTex, const SDL_Rect& src,
 		bool useCamera = true, const SDL_FColor& color = { 1.0f, 1.0f, 1.0f, 1.0f }, bool flipH = false, bool flipV = false);
+	// draws the sprite's pixels through one of the atlas' palettes (see TextureAtlas::add_tinted_palette)
+	// the software backend swaps the palette at draw time, the hardware one can only fall back on the palette's tint
+	// (so it draws add_palette_swap palettes with the base colors, and complains about it once)
+	void queue_sprite_palette(int x, int y, uint32_t spriteIdx, uint16_t atlasPalette, const SDL_Rect& src,
+		bool useCamera = true, bool flipH = false, bool flipV = false);
 
 
 	// these are commented because the compiler has trouble with overloads if you omit the color argument
@@ -41,6 +117,12 @@ struct Gfx {
 	void begin_frame();
 	void finish_frame();
 
+	// writes the commands of the last finished frame to a file, for load_frame and queue_frame
+	bool dump_frame(const char* path) const;
+	static bool load_frame(const char* path, mems::Arena& arena, RenderCmdStream& stream);
+	// records a loaded frame into the current one, as if all of its queue_* calls happened again
+	void queue_frame(const RenderCmdStream& stream);
+
 	// utility functions
 	static SDL_FColor hsv_to_col(float h, float s, float v, float a);
 	SDL_FPoint world_to_screen(SDL_FPoint pt) const;
@@ -49,9 +131,45 @@ struct Gfx {
 	SDL_FRect cam_bboxf() const;
 
 private:
+	Backend backend = HARDWARE;
 	const TextureAtlas* spriteAtlas = nullptr;
 	SDL_Window* windowPtr = nullptr;
 
+	// the recorded frame, this is kept until the next begin_frame so it can still be dumped
+	static constexpr uint32_t MAX_CMDS = 1 << 20;
+	static constexpr uint32_t MAX_COLORS = UINT16_MAX + 1;
+	tds::ArenaArray<RenderCmd> cmds;
+	tds::ArenaArray<SDL_FColor> palette;
+	tds::ArenaMap<uint32_t, uint16_t> paletteLookup;    // packed RGBA8 -> palette index
+	mems::Arena paletteArena;
+	uint32_t lastColorKey = 0;    // almost every command is the same color as the previous one
+	uint16_t lastColorIdx = UINT16_MAX;
+
+	static constexpr uint16_t NO_PALETTE = UINT16_MAX;
+	void _record(float x, float y, float w, float h, int srcX, int srcY, const SDL_FColor& color, uint8_t flags, uint16_t atlasPalette = NO_PALETTE);
+	uint16_t _intern_color(const SDL_FColor& color);
+
+	// text cache, glyphs are kept as already snapped and culled commands
+	// only color and layer get filled in when a run is queued again
+	struct TextRun {
+		uint32_t firstGlyph;    // into textGlyphs
+		uint32_t nGlyphs;
+		uint32_t capacity;      // counters keep room for the longest number, so they can be laid out again in place
+		int value;              // queue_counter only
+	};
+	static constexpr uint32_t MAX_TEXT_GLYPHS = 1 << 14;
+	static constexpr uint32_t MAX_TEXT_RUNS = 1024;
+	tds::ArenaArray<RenderCmd> textGlyphs;
+	tds::ArenaArray<TextRun> textRuns;
+	tds::ArenaMap<uint64_t, uint32_t> textLookup;    // hash of text, position and color -> index into textRuns
+	mems::Arena textArena;
+
+	void _layout_text(int x, int y, const char* text, size_t len, const SDL_FColor& color);
+	void _store_text_run(TextRun& run, uint32_t firstCmd);
+	uint32_t _cache_text_run(uint64_t key, uint32_t firstCmd, uint32_t capacity, int value);
+	void _queue_text_run(const TextRun& run, const SDL_FColor& color);
+	void _clear_text_cache();
+
 #ifndef USE_SDL_RENDERER
 	//
 	// SDL_GPU
@@ -82,8 +200,34 @@ private:
 #else
 	// SDL_Renderer
 	SDL_Renderer* renderer = nullptr;
-	SDL_Texture* textureAtlas = nullptr;
+	static constexpr int MAX_ATLAS_PAGES = 16;    // TextureAtlas::MAX_PAGES
+	SDL_Texture* textureAtlas[MAX_ATLAS_PAGES] = {};    // one per page
 	SDL_Texture* textureScreen1 = nullptr;
 
+	// queue_* functions only append quads here, everything gets drawn with SDL_RenderGeometry in _flush_batches
+	// a new batch is only started when the texture changes (e.g. sprites vs untextured rects, another atlas page or palette)
+	struct DrawBatch {
+		SDL_Texture* texture;    // nullptr for untextured geometry, and always for the software backend
+		const uint32_t* palette;    // the colors of the indexed atlas, software backend only
+		int page;    // of the atlas, -1 for untextured geometry
+		uint32_t firstQuad;
+		uint32_t nQuads;
+	};
+
+	static constexpr uint32_t MAX_BATCH_QUADS = 1 << 16;    // when this fills up mid frame, we just flush early
+	tds::ArenaArray<SDL_Vertex> vertices;
+	tds::ArenaArray<DrawBatch> batches;
+	tds::ArenaArray<int> quadIndices;    // every quad uses the same 6 indices, so this gets built once and shared by all batches
+	FrameStats frameStats = {};
+
+	SoftRaster softRaster;
+	SDL_Texture* textureSoftware = nullptr;    // softRaster gets uploaded here once per frame
+	bool capturingQuads = false;    // the hardware backend hands every batch it draws this frame to capture too
+
+	void _push_quad(int page, const uint32_t* atlasPalette, const SDL_FRect& dest, float u0, float v0, float u1, float v1, const SDL_FColor& color);
+	void _flush_batches();
+	void _execute_commands();
+	void _capture_frame();
+
 #endif
 };
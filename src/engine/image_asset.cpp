@@ -9,6 +9,10 @@
 #include <stb_rect_pack.h>
 #include <mems.hpp>
 
+#include <SDL3/SDL_thread.h>
+#include <SDL3/SDL_cpuinfo.h>
+
+#include <atomic>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,92 +20,153 @@
 void TextureAtlas::create(int w, int h) {
 	width = w;
 	height = h;
-	nSubtextures = 0;
-	memset(subTextures, 0, sizeof(SubTexture) * MAX_SUBTEXTURES);
+	subTextures.init(MAX_SUBTEXTURES, "SubTextures");
 	memset(&arena, 0, sizeof(mems::Arena));
-
-	arena.alloc();
-	data = arena.push(width * height * NUM_CHANNELS);
+	memset(&pageArena, 0, sizeof(mems::Arena));
+	memset(&pathArena, 0, sizeof(mems::Arena));
+
+	arena.alloc(mems::Arena::DEFAULT_CAPACITY, "TextureAtlas");
+	pathArena.alloc(mems::Arena::DEFAULT_CAPACITY, "TextureAtlas paths");
+
+	// the pixel data alone is several megabytes per page that get written once and then uploaded linearly
+	// this only reserves room for every page, they get committed as they're added
+	pageArena.alloc(page_bytes() * MAX_PAGES + 1, "TextureAtlas pages", mems::Arena::HUGE_PAGES);
+	data = pageArena.push(0);
+	nPages = 0;
+	_add_page();
+	indexedData = nullptr;
+	indexedExact = false;
+	palettes.init(MAX_PALETTES, "Atlas palettes");
+	spriteLookup.init(arena, 256);
+
+	// a cooked atlas is only good for the same size (and cooked format)
+	inputHash = 0;
+	const uint32_t layout[] = { COOKED_VERSION, static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+	_hash_input(layout, sizeof(layout));
 
 	isPacked = false;
+	isCooked = false;
 }
 
 void TextureAtlas::destroy() {
 	width = 0;
 	height = 0;
-	nSubtextures = 0;
-	memset(subTextures, 0, sizeof(SubTexture) * MAX_SUBTEXTURES);
+	subTextures.release();
+	palettes.release();
 
 	arena.dealloc();
+	if (data) pageArena.dealloc();    // release_rgba might have already
+	pathArena.dealloc();
+	spriteLookup = {};
+	nPages = 0;
 	data = nullptr;
+	indexedData = nullptr;
+	indexedExact = false;
 	isPacked = false;
+	isCooked = false;
 }
 
-// assumes that mems::init() has been called, as the scratch arena is used
-// we'll also impose a 10mb texture size limit
+// we'll impose a 10mb texture size limit
 // (assuming uncompressed 4-channel color, this is around a 1024x1024 image)
 uint32_t TextureAtlas::add_to_atlas(const char* key, const char* imagePath, const char* jsonPath) {
 	if (isPacked)	// cannot add to an already packed atlas
 		return UINT32_MAX;
 
-	FILE* fp = fopen(imagePath, "rb");
-	if (!fp) {
-		fprintf(stderr, "Could not add %s to TextureAtlas!\n", imagePath);
+	if (subTextures.size >= subTextures.capacity) {
+		fprintf(stderr, "Could not add %s to TextureAtlas, it already has %u sprites!\n", imagePath, subTextures.size);
 		return INVALID_IDX;
 	}
 
-	fseek(fp, 0, SEEK_END);
-	long fileSize = ftell(fp);
-	constexpr long MAX_FILE_SIZE = 1000 * 1000 * 10;
-	if (fileSize > MAX_FILE_SIZE) {
-		fclose(fp);
+	mems::MappedFile file;
+	if (!mems::map_file(file, imagePath)) {
+		fprintf(stderr, "Could not add %s to TextureAtlas!\n", imagePath);
 		return INVALID_IDX;
 	}
 
-	mems::Arena& scratch = mems::get_scratch();
-	mems::ArenaScope scratchScope(scratch);
-	
-	void* fileData = scratch.push(fileSize);
-	fseek(fp, 0, SEEK_SET);
-	if (1 != fread(fileData, fileSize, 1, fp)) {
-		// fread returns the number of "items" read
-		// we're asking fread for 1 item of size fileSize
-		// so if we don't get that 1 item, then we need to report an error
+	constexpr size_t MAX_FILE_SIZE = 1000 * 1000 * 10;
+	if (file.size > MAX_FILE_SIZE) {
+		mems::unmap_file(file);
 		return INVALID_IDX;
 	}
-	fclose(fp);
 
-	// now we actually load the image
-	SubTexture subTex = {};
-	int requestedChannels;
-	subTex.data = static_cast<void*>(
-		stbi_load_from_memory(
-			static_cast<stbi_uc*>(fileData),
-			fileSize,
-			&subTex.width,
-			&subTex.height,
-			&requestedChannels, NUM_CHANNELS)
-		);
+	// NOTE: nothing gets decoded yet, if the atlas turns out to be cooked it never has to be
+	_hash_input(file.data, file.size);
+	mems::unmap_file(file);
 
+	SubTexture subTex = {};
 	if (key) strncpy(subTex.key, key, SubTexture::KEY_LENGTH);
-	else snprintf(subTex.key, SubTexture::KEY_LENGTH, "sprite%d", nSubtextures);
+	else snprintf(subTex.key, SubTexture::KEY_LENGTH, "sprite%u", subTextures.size);
+	subTex.group = group;
+	_hash_input(subTex.key, SubTexture::KEY_LENGTH);
+	_hash_input(&subTex.group, sizeof(subTex.group));
+
+	subTex.imagePath = mems::push_printf(pathArena, "%s", imagePath);
+	if (jsonPath) {
+		add_cook_input(jsonPath);
+		subTex.jsonPath = mems::push_printf(pathArena, "%s", jsonPath);
+	}
+
+	subTextures.push(subTex);
+	_index_key(subTextures.size - 1);
 
-	if (jsonPath) subTex.sheetData = SpriteSheet::load(jsonPath, arena);
-	else subTex.sheetData = nullptr;
+	return subTextures.size - 1;
+}
+
+uint32_t TextureAtlas::reserve_sprite(const char* key, int w, int h) {
+	if (isPacked)
+		return INVALID_IDX;
 
-	subTextures[nSubtextures] = subTex;
+	if (subTextures.size >= subTextures.capacity) {
+		fprintf(stderr, "Could not reserve %s in TextureAtlas, it already has %u sprites!\n", key, subTextures.size);
+		return INVALID_IDX;
+	}
 
-	return nSubtextures++;
-	// scratchScope goes out of scope so all scratch arena memory from this function is freed
+	// no pixels yet, _move_subtex_to_atlas just clears the spot this gets packed to
+	SubTexture subTex = {};
+	subTex.width = w;
+	subTex.height = h;
+	subTex.data = nullptr;
+	subTex.sheetData = nullptr;
+	strncpy(subTex.key, key, SubTexture::KEY_LENGTH);
+	subTex.group = group;
+	subTextures.push(subTex);
+	_index_key(subTextures.size - 1);
+
+	const int size[] = { w, h, group };
+	_hash_input(subTex.key, SubTexture::KEY_LENGTH);
+	_hash_input(size, sizeof(size));
+
+	return subTextures.size - 1;
 }
 
-uint32_t TextureAtlas::find_sprite(const char* key) const {
-	for (uint32_t i = 0; i < static_cast<uint32_t>(nSubtextures); i++) {
-		if (0 == strncmp(subTextures[i].key, key, SubTexture::KEY_LENGTH))
-			return i;
+// hashed the same way as _sprite, keys aren't null terminated when they're exactly KEY_LENGTH long
+static uint64_t key_hash(const char* key) {
+	return tds::fnv1a(key, strnlen(key, SubTexture::KEY_LENGTH));
+}
+
+void TextureAtlas::_index_key(uint32_t idx) {
+	const SubTexture& subTex = subTextures[idx];
+	const uint64_t hash = key_hash(subTex.key);
+	if (const uint32_t* existing = spriteLookup.find(hash)) {
+		if (0 != strncmp(subTextures[*existing].key, subTex.key, SubTexture::KEY_LENGTH))
+			fprintf(stderr, "Sprite keys %.32s and %.32s have the same hash, only the first can be found!\n", subTextures[*existing].key, subTex.key);
+		return;
 	}
 
-	return INVALID_IDX;
+	spriteLookup.put(hash, idx);
+}
+
+uint32_t TextureAtlas::find(SpriteKey key) const {
+	const uint32_t* idx = spriteLookup.find(key.hash);
+	return idx ? *idx : INVALID_IDX;
+}
+
+uint32_t TextureAtlas::find_sprite(const char* key) const {
+	// NOTE: unlike a literal, this has the actual string, so a hash collision can't hand back the wrong sprite
+	const uint32_t idx = find(SpriteKey{ key_hash(key) });
+	if (idx == INVALID_IDX || 0 != strncmp(subTextures[idx].key, key, SubTexture::KEY_LENGTH))
+		return INVALID_IDX;
+	return idx;
 }
 
 // this function packs the rects into the atlas and frees the subtextures on the CPU-side
@@ -109,53 +174,233 @@ void TextureAtlas::pack_atlas() {
 	if (isPacked)
 		return;
 
+	_load_sources();
+
 	mems::Arena& scratch = mems::get_scratch();
 	mems::ArenaScope scratchScope(scratch);
 
-	stbrp_context rpContext;
-	stbrp_node* rpNodes = static_cast<stbrp_node*>(scratch.push(sizeof(stbrp_node) * width));
-	stbrp_init_target(&rpContext, width, height, rpNodes, width);
+	// group by group, in the order they were added inside a group
+	const uint32_t nSubtextures = subTextures.size;
+	uint64_t* order = static_cast<uint64_t*>(scratch.push_aligned(sizeof(uint64_t) * nSubtextures, alignof(uint64_t)));
+	uint64_t* tmp = static_cast<uint64_t*>(scratch.push_aligned(sizeof(uint64_t) * nSubtextures, alignof(uint64_t)));
+	for (uint32_t i = 0; i < nSubtextures; i++) order[i] = (static_cast<uint64_t>(subTextures[i].group) << 32) | i;
+	order = tds::radix_sort(order, tmp, nSubtextures, 4, 5);
+
+	int rectsNotPacked = 0;
+	stbrp_rect* rpRects = static_cast<stbrp_rect*>(scratch.push_aligned(sizeof(stbrp_rect) * nSubtextures, alignof(stbrp_rect)));
+	uint32_t nRects = 0;
+	for (uint32_t i = 0; i < nSubtextures; i++) {
+		const uint32_t idx = static_cast<uint32_t>(order[i]);
+		SubTexture& cSubtex = subTextures[idx];
+		if (cSubtex.width > width || cSubtex.height > height) {
+			fprintf(stderr, "Could not fit %.32s (%dx%d) in the atlas, it's bigger than a page!\n", cSubtex.key, cSubtex.width, cSubtex.height);
+			_drop_subtex(cSubtex);
+			rectsNotPacked++;
+			continue;
+		}
 
-	stbrp_rect* rpRects = static_cast<stbrp_rect*>(scratch.push(sizeof(stbrp_rect) * nSubtextures));
-	for (int i = 0; i < nSubtextures; i++) {
 		// to correlate the rects to their textures
-		rpRects[i].id = i;
-		rpRects[i].w = subTextures[i].width;
-		rpRects[i].h = subTextures[i].height;
+		stbrp_rect& rect = rpRects[nRects++];
+		rect = {};
+		rect.id = static_cast<int>(idx);
+		rect.w = cSubtex.width;
+		rect.h = cSubtex.height;
 	}
 
-	if (1 != stbrp_pack_rects(&rpContext, rpRects, nSubtextures)) {
-		fprintf(stderr, "stb_rect_pack couldn't pack all textures!\n");
-	}
+	// NOTE: stb_rect_pack can keep packing into a target over several calls, but it can't take anything back out.
+	// So to move a whole group to a new page, the target gets saved before the group and restored if it didn't fit
+	stbrp_context rpContext, savedContext;
+	stbrp_node* rpNodes = static_cast<stbrp_node*>(scratch.push_aligned(sizeof(stbrp_node) * width, alignof(stbrp_node)));
+	stbrp_node* savedNodes = static_cast<stbrp_node*>(scratch.push_aligned(sizeof(stbrp_node) * width, alignof(stbrp_node)));
+	stbrp_init_target(&rpContext, width, height, rpNodes, width);
+	int page = 0;
+	bool pageEmpty = true;
+
+	for (uint32_t groupStart = 0; groupStart < nRects;) {
+		const uint8_t group = subTextures[rpRects[groupStart].id].group;
+		uint32_t groupEnd = groupStart + 1;
+		while (groupEnd < nRects && subTextures[rpRects[groupEnd].id].group == group) groupEnd++;
+
+		stbrp_rect* rects = rpRects + groupStart;
+		int nLeft = static_cast<int>(groupEnd - groupStart);
+		groupStart = groupEnd;
+
+		savedContext = rpContext;
+		memcpy(savedNodes, rpNodes, sizeof(stbrp_node) * width);
+		if (!stbrp_pack_rects(&rpContext, rects, nLeft) && !pageEmpty && page + 1 < MAX_PAGES) {
+			rpContext = savedContext;
+			memcpy(rpNodes, savedNodes, sizeof(stbrp_node) * width);
+
+			page++;
+			pageEmpty = true;
+			stbrp_init_target(&rpContext, width, height, rpNodes, width);
+			stbrp_pack_rects(&rpContext, rects, nLeft);
+		}
 
-	int rectsNotPacked = 0;
-	for (int i = 0; i < nSubtextures; i++) {
-		const stbrp_rect& rect = rpRects[i];
-		SubTexture& cSubtex = subTextures[rect.id];
+		// whatever got packed stays on this page. A group bigger than a page spills onto as many new ones as it needs
+		// (everything fits on an empty page on its own, so each new page takes at least one)
+		while (nLeft > 0) {
+			int nUnpacked = 0;
+			for (int i = 0; i < nLeft; i++) {
+				const stbrp_rect& rect = rects[i];
+				if (!rect.was_packed) {
+					rects[nUnpacked++] = rect;
+					continue;
+				}
+
+				SubTexture& cSubtex = subTextures[rect.id];
+				cSubtex.x = rect.x;
+				cSubtex.y = rect.y;
+				cSubtex.page = page;
+				pageEmpty = false;
+			}
 
-		if (0 != rect.was_packed) {
-			cSubtex.x = rect.x;
-			cSubtex.y = rect.y;
-			cSubtex.width = rect.w;
-			cSubtex.height = rect.h;
+			nLeft = nUnpacked;
+			if (nLeft == 0) break;
+
+			if (page + 1 >= MAX_PAGES) {
+				for (int i = 0; i < nLeft; i++) {
+					SubTexture& cSubtex = subTextures[rects[i].id];
+					fprintf(stderr, "Could not fit %.32s (%dx%d) in the atlas, it's out of pages!\n", cSubtex.key, cSubtex.width, cSubtex.height);
+					_drop_subtex(cSubtex);
+				}
+				rectsNotPacked += nLeft;
+				break;
+			}
 
-			_move_subtex_to_atlas(rect.id);
-		} else {
-			rectsNotPacked++;
+			page++;
+			pageEmpty = true;
+			stbrp_init_target(&rpContext, width, height, rpNodes, width);
+			stbrp_pack_rects(&rpContext, rects, nLeft);
 		}
 	}
 
+	while (nPages <= page) _add_page();
+
+	for (uint32_t i = 0; i < nSubtextures; i++) {
+		if (subTextures[i].x >= 0) _move_subtex_to_atlas(static_cast<int>(i));
+	}
+
 	if (rectsNotPacked != 0) {
-		fprintf(stderr, "%d textures not packed!", rectsNotPacked);
+		fprintf(stderr, "%d textures not packed!\n", rectsNotPacked);
 	}
 
 	isPacked = true;
 }
 
-// copies subtex at idx to the main atlas data, at the destination rectangle with the top left position (x,y)
+// NOTE: this is how reserve_sprite users can tell their sprite has no place in the atlas
+void TextureAtlas::_drop_subtex(SubTexture& subtex) {
+	subtex.x = -1;
+	subtex.y = -1;
+	subtex.page = 0;
+	if (subtex.data) stbi_image_free(subtex.data);
+	subtex.data = nullptr;
+}
+
+bool TextureAtlas::_add_page() {
+	if (nPages >= MAX_PAGES) return false;
+
+	pageArena.push_zero(page_bytes());
+	nPages++;
+	return true;
+}
+
+struct DecodeQueue {
+	TextureAtlas* atlas;
+	std::atomic<uint32_t> next;
+};
+
+// decodes everything add_to_atlas added, right before it gets packed
+// the images decode on a thread per core, every one into its own SubTexture, so the result is the same as
+// decoding them one after another. An image that doesn't decode stays in the atlas as an empty sprite,
+// so the indices handed out don't change
+void TextureAtlas::_load_sources() {
+	uint32_t nImages = 0;
+	for (const SubTexture& subTex : subTextures) {
+		if (subTex.imagePath) nImages++;
+	}
+
+	// NOTE: the calling thread decodes too, so the threads are only the extra cores
+	DecodeQueue queue = { this, 0 };
+	SDL_Thread* threads[MAX_DECODE_THREADS];
+	int nThreads = 0;
+	const int cores = decodeThreads > 0 ? decodeThreads : SDL_GetNumLogicalCPUCores();
+	const int nWorkers = tim::min(tim::min(cores, static_cast<int>(nImages)) - 1, MAX_DECODE_THREADS);
+	for (int i = 0; i < nWorkers; i++) {
+		threads[nThreads] = SDL_CreateThread(_decode_worker, "AtlasDecode", &queue);
+		if (threads[nThreads]) nThreads++;
+	}
+	_decode_worker(&queue);
+	for (int i = 0; i < nThreads; i++) SDL_WaitThread(threads[i], nullptr);
+
+	// sheets share the json parser and the atlas arena, so they stay on this thread
+	for (SubTexture& subTex : subTextures) {
+		if (!subTex.imagePath) continue;
+
+		if (subTex.jsonPath) subTex.sheetData = SpriteSheet::load(subTex.jsonPath, arena);
+
+		subTex.imagePath = nullptr;
+		subTex.jsonPath = nullptr;
+	}
+	pathArena.clear_decommit();
+}
+
+int TextureAtlas::_decode_worker(void* queuePtr) {
+	DecodeQueue& queue = *static_cast<DecodeQueue*>(queuePtr);
+	tds::ArenaArray<SubTexture>& subTextures = queue.atlas->subTextures;
+
+	while (true) {
+		const uint32_t idx = queue.next.fetch_add(1, std::memory_order_relaxed);
+		if (idx >= subTextures.size) break;
+
+		SubTexture& subTex = subTextures[idx];
+		if (!subTex.imagePath) continue;
+
+		// the png gets decoded straight out of the mapping, so the compressed bytes are never copied
+		mems::MappedFile file;
+		if (!mems::map_file(file, subTex.imagePath)) {
+			fprintf(stderr, "Could not open %s\n", subTex.imagePath);
+		} else {
+			int requestedChannels;
+			subTex.data = static_cast<void*>(
+				stbi_load_from_memory(
+					static_cast<const stbi_uc*>(file.data),
+					static_cast<int>(file.size),
+					&subTex.width,
+					&subTex.height,
+					&requestedChannels, NUM_CHANNELS)
+				);
+			mems::unmap_file(file);
+
+			// stbi_failure_reason is thread local, so this has to be reported from here
+			if (!subTex.data) {
+				const char* reason = stbi_failure_reason();
+				fprintf(stderr, "Could not decode %s: %s\n", subTex.imagePath, reason ? reason : "unknown error");
+			}
+		}
+
+		if (!subTex.data) {
+			subTex.width = 0;
+			subTex.height = 0;
+		}
+	}
+
+	return 0;
+}
+
+// copies subtex at idx to its page of the atlas data, at the destination rectangle with the top left position (x,y)
 void TextureAtlas::_move_subtex_to_atlas(int idx) {
 	SubTexture& subtex = subTextures[idx];
 
+	// reserved sprites don't have anything to copy yet
+	if (!subtex.data) {
+		for (int i = 0; i < subtex.height; i++) {
+			uint32_t* dst = static_cast<uint32_t*>(page_data(subtex.page)) + ((subtex.y + i) * width) + subtex.x;
+			memset(dst, 0, NUM_CHANNELS * subtex.width);
+		}
+		return;
+	}
+
 	// each subtexture was loaded with 4 channels, which the same way as
 	// the actual texture data will be interpreted by the gpu,
 	// so we can just memcpy each horizontal line of pixels onto the atlas
@@ -170,7 +415,7 @@ void TextureAtlas::_move_subtex_to_atlas(int idx) {
 
 	for (int i = 0; i < subtex.height; i++) {
 		uint32_t* src = static_cast<uint32_t*>(subtex.data) + (subtex.width * i);
-		uint32_t* dst = static_cast<uint32_t*>(data) + ((subtex.y + i) * width) + subtex.x;
+		uint32_t* dst = static_cast<uint32_t*>(page_data(subtex.page)) + ((subtex.y + i) * width) + subtex.x;
 		memcpy(dst, src, NUM_CHANNELS * subtex.width);
 	}
 
@@ -179,6 +424,363 @@ void TextureAtlas::_move_subtex_to_atlas(int idx) {
 }
 
 
+void TextureAtlas::build_indexed() {
+	assert(isPacked);
+	assert(palettes.size == 0);
+
+	mems::Arena& scratch = mems::get_scratch();
+	mems::ArenaScope scratchScope(scratch);
+
+	const uint32_t* pixels = static_cast<const uint32_t*>(data);
+	const uint32_t nPixels = static_cast<uint32_t>(width) * height * nPages;
+
+	// exact colors if they fit, otherwise keep dropping a bit off of every channel until they do
+	// each slot keeps the first color that landed in it. Anything that masks to 0 (e.g. almost transparent and dark)
+	// goes to slot 0 with the transparent pixels, so at 2 bits per channel the other 4 * 4 * 4 * 4 - 1 keys always fit in 255 slots
+	Palette& base = palettes.push(Palette{});
+	base.tint = { 1.0f, 1.0f, 1.0f, 1.0f };
+	base.tintOnly = true;
+	tds::ArenaMap<uint32_t, uint8_t> slots;
+	uint32_t mask = 0xFFFFFFFF;
+	int droppedBits = 0;
+	for (; droppedBits <= 6; droppedBits++) {
+		mask = (0xFFu << droppedBits) & 0xFF;
+		mask |= (mask << 8) | (mask << 16) | (mask << 24);
+
+		slots.init(scratch, PALETTE_SIZE);
+		uint32_t nColors = 1;
+		bool fits = true;
+		for (uint32_t i = 0; i < nPixels && fits; i++) {
+			const uint32_t key = pixels[i] & mask;
+			if (key == 0 || slots.find(key)) continue;
+
+			if (nColors == PALETTE_SIZE) {
+				fits = false;
+				break;
+			}
+			base.colors[nColors] = pixels[i];
+			slots.put(key, static_cast<uint8_t>(nColors++));
+		}
+		if (fits) break;
+	}
+
+	if (droppedBits > 0)
+		fprintf(stderr, "Atlas has more than %u colors, the indexed atlas drops %d bits per channel\n", PALETTE_SIZE - 1, droppedBits);
+	indexedExact = droppedBits == 0;
+
+	indexedData = static_cast<uint8_t*>(arena.push(nPixels));
+	uint32_t lastPixel = 0;
+	uint8_t lastSlot = 0;
+	for (uint32_t i = 0; i < nPixels; i++) {
+		// NOTE: sprites are mostly runs of the same color (or transparency), so this skips most of the lookups
+		if (pixels[i] != lastPixel) {
+			lastPixel = pixels[i];
+			const uint32_t key = lastPixel & mask;
+			const uint8_t* slot = key == 0 ? nullptr : slots.find(key);
+			assert(key == 0 || slot);
+			lastSlot = slot ? *slot : 0;
+		}
+		indexedData[i] = lastSlot;
+	}
+}
+
+bool TextureAtlas::release_rgba() {
+	if (!indexedData || !indexedExact) return false;
+
+	// NOTE: not clear_decommit, that keeps the first huge page around
+	pageArena.dealloc();
+	data = nullptr;
+	return true;
+}
+
+//
+// Cooked atlas
+//
+// [CookedHeader][CookedSubTexture * nSubTextures][CookedSheet * nSheets][AnimationFrame * nFrames][AnimationMeta * nAnims][pages]
+// every section starts 16 byte aligned, cooked_layout is the only place that knows the offsets
+
+static constexpr uint32_t COOKED_MAGIC = 0x4C544143;    // "CATL"
+
+struct CookedHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t inputHash;
+	int32_t width, height;    // of a page
+	uint32_t nPages;
+	uint32_t nSubTextures;
+	uint32_t nSheets;
+	uint32_t nFrames;
+	uint32_t nAnims;
+};
+
+struct CookedSubTexture {
+	int32_t x, y;
+	int32_t width, height;
+	int32_t page;
+	int32_t sheet;    // -1 if it has no SpriteSheet
+	char key[SubTexture::KEY_LENGTH];
+};
+
+struct CookedSheet {
+	int32_t nFrames;
+	int32_t nAnimations;
+	uint32_t firstFrame;    // into the frames section
+	uint32_t firstAnim;     // into the anims section
+};
+
+struct CookedLayout {
+	size_t subTextures, sheets, frames, anims, pixels;
+	size_t size;
+};
+
+static CookedLayout cooked_layout(const CookedHeader& header) {
+	auto align = [](size_t offset) { return (offset + 15) & ~static_cast<size_t>(15); };
+
+	CookedLayout layout;
+	layout.subTextures = align(sizeof(CookedHeader));
+	layout.sheets = align(layout.subTextures + sizeof(CookedSubTexture) * header.nSubTextures);
+	layout.frames = align(layout.sheets + sizeof(CookedSheet) * header.nSheets);
+	layout.anims = align(layout.frames + sizeof(AnimationFrame) * header.nFrames);
+	layout.pixels = align(layout.anims + sizeof(AnimationMeta) * header.nAnims);
+	layout.size = layout.pixels + static_cast<size_t>(header.width) * header.height * TextureAtlas::NUM_CHANNELS * header.nPages;
+	return layout;
+}
+
+void TextureAtlas::_hash_input(const void* bytes, size_t len) {
+	inputHash = tds::mix64(inputHash ^ tds::fnv1a(static_cast<const char*>(bytes), len));
+}
+
+void TextureAtlas::add_cook_input(const char* path) {
+	mems::MappedFile file;
+	if (!mems::map_file(file, path)) {
+		// still has to change the hash, a file going missing is a change too
+		_hash_input(path, strlen(path));
+		return;
+	}
+
+	_hash_input(file.data, file.size);
+	mems::unmap_file(file);
+}
+
+// every index and rect in the file has to land inside the sections/pages it points at
+static bool cooked_in_bounds(const CookedHeader& header, const CookedSubTexture* cookedSubTextures, const CookedSheet* cookedSheets) {
+	for (uint32_t i = 0; i < header.nSheets; i++) {
+		const CookedSheet& sheet = cookedSheets[i];
+		if (sheet.nFrames < 0 || sheet.nAnimations < 0) return false;
+		if (static_cast<uint64_t>(sheet.firstFrame) + static_cast<uint32_t>(sheet.nFrames) > header.nFrames) return false;
+		if (static_cast<uint64_t>(sheet.firstAnim) + static_cast<uint32_t>(sheet.nAnimations) > header.nAnims) return false;
+	}
+
+	for (uint32_t i = 0; i < header.nSubTextures; i++) {
+		const CookedSubTexture& cooked = cookedSubTextures[i];
+		if (cooked.sheet < -1 || (cooked.sheet >= 0 && static_cast<uint32_t>(cooked.sheet) >= header.nSheets)) return false;
+		if (cooked.page < 0 || static_cast<uint32_t>(cooked.page) >= header.nPages) return false;
+		if (cooked.x < 0 || cooked.y < 0 || cooked.width < 0 || cooked.height < 0) return false;
+		if (cooked.width > header.width - cooked.x || cooked.height > header.height - cooked.y) return false;
+	}
+	return true;
+}
+
+bool TextureAtlas::load_cooked(const char* path) {
+	if (isPacked)
+		return false;
+
+	mems::MappedFile file;
+	if (!mems::map_file(file, path))
+		return false;    // nothing cooked yet
+
+	CookedHeader header = {};
+	if (file.size >= sizeof(header)) memcpy(&header, file.data, sizeof(header));
+
+	// the hash covers everything that was added, so if it matches the counts have to as well
+	// they're still checked (here and in cooked_in_bounds) so a truncated or hand edited file can't read out of bounds
+	const CookedLayout layout = cooked_layout(header);
+	if (header.magic != COOKED_MAGIC || header.version != COOKED_VERSION || header.inputHash != inputHash ||
+		header.width != width || header.height != height || header.nPages == 0 || header.nPages > MAX_PAGES ||
+		header.nSubTextures != subTextures.size || layout.size != file.size) {
+		printf("%s is out of date, cooking the atlas again\n", path);
+		mems::unmap_file(file);
+		return false;
+	}
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(file.data);
+	const CookedSubTexture* cookedSubTextures = reinterpret_cast<const CookedSubTexture*>(bytes + layout.subTextures);
+	const CookedSheet* cookedSheets = reinterpret_cast<const CookedSheet*>(bytes + layout.sheets);
+	if (!cooked_in_bounds(header, cookedSubTextures, cookedSheets)) {
+		fprintf(stderr, "%s points outside of itself, cooking the atlas again\n", path);
+		mems::unmap_file(file);
+		return false;
+	}
+
+	// the sheets point into the frames and anims copied right after them, so everything stays in the atlas arena
+	SpriteSheet* sheets = static_cast<SpriteSheet*>(arena.push_aligned(sizeof(SpriteSheet) * header.nSheets, alignof(SpriteSheet)));
+	AnimationFrame* frames = static_cast<AnimationFrame*>(arena.push_aligned(sizeof(AnimationFrame) * header.nFrames, alignof(AnimationFrame)));
+	AnimationMeta* anims = static_cast<AnimationMeta*>(arena.push_aligned(sizeof(AnimationMeta) * header.nAnims, alignof(AnimationMeta)));
+	memcpy(frames, bytes + layout.frames, sizeof(AnimationFrame) * header.nFrames);
+	memcpy(anims, bytes + layout.anims, sizeof(AnimationMeta) * header.nAnims);
+	for (uint32_t i = 0; i < header.nSheets; i++) {
+		sheets[i].nFrames = cookedSheets[i].nFrames;
+		sheets[i].nAnimations = cookedSheets[i].nAnimations;
+		sheets[i].frames = frames + cookedSheets[i].firstFrame;
+		sheets[i].anims = anims + cookedSheets[i].firstAnim;
+	}
+
+	for (uint32_t i = 0; i < subTextures.size; i++) {
+		const CookedSubTexture& cooked = cookedSubTextures[i];
+		SubTexture& subTex = subTextures[i];
+		subTex.x = cooked.x;
+		subTex.y = cooked.y;
+		subTex.width = cooked.width;
+		subTex.height = cooked.height;
+		subTex.page = cooked.page;
+		subTex.sheetData = cooked.sheet < 0 ? nullptr : &sheets[cooked.sheet];
+		memcpy(subTex.key, cooked.key, SubTexture::KEY_LENGTH);
+		subTex.data = nullptr;
+		subTex.imagePath = nullptr;
+		subTex.jsonPath = nullptr;
+	}
+	pathArena.clear_decommit();
+
+	while (nPages < static_cast<int>(header.nPages)) _add_page();
+	memcpy(data, bytes + layout.pixels, page_bytes() * nPages);
+	mems::unmap_file(file);
+
+	isPacked = true;
+	isCooked = true;
+	return true;
+}
+
+bool TextureAtlas::save_cooked(const char* path) const {
+	assert(isPacked);
+
+	mems::Arena& scratch = mems::get_scratch();
+	mems::ArenaScope scratchScope(scratch);
+
+	CookedHeader header = {};
+	header.magic = COOKED_MAGIC;
+	header.version = COOKED_VERSION;
+	header.inputHash = inputHash;
+	header.width = width;
+	header.height = height;
+	header.nPages = nPages;
+	header.nSubTextures = subTextures.size;
+
+	CookedSubTexture* cookedSubTextures = static_cast<CookedSubTexture*>(scratch.push_zero_aligned(sizeof(CookedSubTexture) * subTextures.size, alignof(CookedSubTexture)));
+	CookedSheet* cookedSheets = static_cast<CookedSheet*>(scratch.push_zero_aligned(sizeof(CookedSheet) * subTextures.size, alignof(CookedSheet)));
+	for (uint32_t i = 0; i < subTextures.size; i++) {
+		const SubTexture& subTex = subTextures[i];
+		CookedSubTexture& cooked = cookedSubTextures[i];
+		cooked.x = subTex.x;
+		cooked.y = subTex.y;
+		cooked.width = subTex.width;
+		cooked.height = subTex.height;
+		cooked.page = subTex.page;
+		cooked.sheet = -1;
+		memcpy(cooked.key, subTex.key, SubTexture::KEY_LENGTH);
+
+		if (subTex.sheetData) {
+			cooked.sheet = static_cast<int32_t>(header.nSheets);
+			cookedSheets[header.nSheets++] = {
+				subTex.sheetData->nFrames, subTex.sheetData->nAnimations, header.nFrames, header.nAnims
+			};
+			header.nFrames += subTex.sheetData->nFrames;
+			header.nAnims += subTex.sheetData->nAnimations;
+		}
+	}
+
+	::FILE* fp = fopen(path, "wb");
+	if (!fp) {
+		fprintf(stderr, "Could not save the cooked atlas to %s\n", path);
+		return false;
+	}
+
+	const CookedLayout layout = cooked_layout(header);
+	size_t written = 0;
+	auto write_at = [&](size_t offset, const void* src, size_t len) {
+		static const uint8_t zeros[16] = {};
+		fwrite(zeros, 1, offset - written, fp);
+		fwrite(src, 1, len, fp);
+		written = offset + len;
+	};
+
+	write_at(0, &header, sizeof(header));
+	write_at(layout.subTextures, cookedSubTextures, sizeof(CookedSubTexture) * header.nSubTextures);
+	write_at(layout.sheets, cookedSheets, sizeof(CookedSheet) * header.nSheets);
+
+	// the frames and anims of every sheet back to back, in the same order the sheets were numbered in
+	size_t offset = layout.frames;
+	for (const SubTexture& subTex : subTextures) {
+		if (!subTex.sheetData) continue;
+		write_at(offset, subTex.sheetData->frames, sizeof(AnimationFrame) * subTex.sheetData->nFrames);
+		offset += sizeof(AnimationFrame) * subTex.sheetData->nFrames;
+	}
+	offset = layout.anims;
+	for (const SubTexture& subTex : subTextures) {
+		if (!subTex.sheetData) continue;
+		write_at(offset, subTex.sheetData->anims, sizeof(AnimationMeta) * subTex.sheetData->nAnimations);
+		offset += sizeof(AnimationMeta) * subTex.sheetData->nAnimations;
+	}
+
+	write_at(layout.pixels, data, page_bytes() * nPages);
+
+	const bool ok = !ferror(fp) && written == layout.size;
+	fclose(fp);
+	if (!ok) {
+		fprintf(stderr, "Could not write the cooked atlas to %s\n", path);
+		remove(path);
+	}
+	return ok;
+}
+
+// same math as a SoftRaster tint, so a tinted palette draws the exact same pixels as drawing with the tint
+static uint32_t tint_color(uint32_t color, const SDL_FColor& tint) {
+	const float t[4] = { tint.r, tint.g, tint.b, tint.a };
+	uint32_t out = 0;
+	for (int c = 0; c < 4; c++) {
+		const uint32_t tc = static_cast<uint32_t>(tim::clamp(t[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+		uint32_t x = ((color >> (c * 8)) & 0xFF) * tc + 128;
+		x = (x + (x >> 8)) >> 8;
+		out |= x << (c * 8);
+	}
+	return out;
+}
+
+uint16_t TextureAtlas::add_tinted_palette(const SDL_FColor& tint) {
+	assert(palettes.size > 0);
+	if (palettes.size >= MAX_PALETTES) {
+		fprintf(stderr, "Atlas is out of palettes!\n");
+		return BASE_PALETTE;
+	}
+
+	const Palette& base = palettes[BASE_PALETTE];
+	Palette& palette = palettes.push(Palette{});
+	for (uint32_t i = 0; i < PALETTE_SIZE; i++) palette.colors[i] = tint_color(base.colors[i], tint);
+	palette.tint = tint;
+	palette.tintOnly = true;
+	return static_cast<uint16_t>(palettes.size - 1);
+}
+
+uint16_t TextureAtlas::add_palette_swap(const uint32_t* from, const uint32_t* to, int n) {
+	assert(palettes.size > 0);
+	if (palettes.size >= MAX_PALETTES) {
+		fprintf(stderr, "Atlas is out of palettes!\n");
+		return BASE_PALETTE;
+	}
+
+	Palette& palette = palettes.push(palettes[BASE_PALETTE]);
+	palette.tint = { 1.0f, 1.0f, 1.0f, 1.0f };
+	palette.tintOnly = false;
+	for (uint32_t i = 1; i < PALETTE_SIZE; i++) {
+		for (int k = 0; k < n; k++) {
+			if (palette.colors[i] == from[k]) {
+				palette.colors[i] = to[k];
+				break;
+			}
+		}
+	}
+	return static_cast<uint16_t>(palettes.size - 1);
+}
+
 
 using namespace simdjson;
 
@@ -190,16 +792,18 @@ using namespace simdjson;
 
 // This function loads a spritesheet from a json filepath, into arena-allocated storage
 SpriteSheet* SpriteSheet::load(const char* jsonPath, mems::Arena& arena) {
-	SpriteSheet* sheet = static_cast<SpriteSheet*>(arena.push_zero(sizeof(SpriteSheet)));
+	SpriteSheet* sheet = static_cast<SpriteSheet*>(arena.push_zero_aligned(sizeof(SpriteSheet), alignof(SpriteSheet)));
 
-	padded_string json = padded_string::load(jsonPath);
+	mems::MappedFile jsonFile;
+	padded_string jsonFallback;
+	padded_string_view json = GameContext::map_json(jsonPath, jsonFile, jsonFallback);
 
 	simdjson::ondemand::document sheetDoc = GET_JSON_PARSER->iterate(json);
 
 	// load source frame rects
 	auto framesVal = sheetDoc["frames"].get_array();
 	sheet->nFrames = static_cast<int>(framesVal.count_elements());
-	sheet->frames = static_cast<AnimationFrame*>(arena.push_zero(sizeof(AnimationFrame) * sheet->nFrames));
+	sheet->frames = static_cast<AnimationFrame*>(arena.push_zero_aligned(sizeof(AnimationFrame) * sheet->nFrames, alignof(AnimationFrame)));
 	int i = 0;    // simdjson's ondemand API with regards to array iteration does not give us the index,
 	              // so we need to manually keep track of it
 
@@ -223,13 +827,13 @@ SpriteSheet* SpriteSheet::load(const char* jsonPath, mems::Arena& arena) {
 	if (0 == sheet->nAnimations) {
 		// make one big animation with the entire sheet
 		sheet->nAnimations = 1;
-		sheet->anims = static_cast<AnimationMeta*>(arena.push_zero(sizeof(AnimationMeta)));
+		sheet->anims = static_cast<AnimationMeta*>(arena.push_zero_aligned(sizeof(AnimationMeta), alignof(AnimationMeta)));
 
 		sheet->anims->startFrame = 0;
 		sheet->anims->endFrame = sheet->nFrames - 1;
 		sheet->anims->type = AnimationMeta::FORWARD;
 	} else {
-		sheet->anims = static_cast<AnimationMeta*>(arena.push_zero(sizeof(AnimationMeta) * sheet->nAnimations));
+		sheet->anims = static_cast<AnimationMeta*>(arena.push_zero_aligned(sizeof(AnimationMeta) * sheet->nAnimations, alignof(AnimationMeta)));
 
 		for (auto frameTag : frameTags) {
 			sheet->anims[i].startFrame = static_cast<int>(frameTag["from"]);
@@ -249,6 +853,7 @@ SpriteSheet* SpriteSheet::load(const char* jsonPath, mems::Arena& arena) {
 		}
 	}
 
+	mems::unmap_file(jsonFile);
 	return sheet;
 }
 
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <stdint.h>
+#include <assert.h>
 #include <SDL3/SDL_rect.h>
+#include <SDL3/SDL_pixels.h>
 
 #include <mems.hpp>
+#include <tinydef.hpp>
 
 //
 // TEXTURES
@@ -12,8 +15,9 @@
 struct SubTexture {
 	static constexpr int KEY_LENGTH = 32;
 
-	int x, y;
+	int x, y;    // in its page
 	int width, height;
+	int page;    // which of the atlas' pages it's in, see TextureAtlas::page_data
 
 	const struct SpriteSheet* sheetData;
 	char key[KEY_LENGTH];
@@ -21,36 +25,145 @@ private:
 	// Only TextureAtlas gets to manage the CPU side texture data
 	friend struct TextureAtlas;
 	void* data;
+	// decoding waits until pack_atlas, so a cooked atlas never has to do it
+	const char* imagePath;
+	const char* jsonPath;
+	uint8_t group;
 };
 
+// A sprite key hashed at compile time, for TextureAtlas::find
+//	uint32_t idx = atlas.find("player"_sprite);
+struct SpriteKey {
+	uint64_t hash;
+};
+
+// keys longer than KEY_LENGTH get cut off in the atlas, so they're hashed cut off too
+consteval SpriteKey operator""_sprite(const char* key, size_t len) {
+	return SpriteKey{ tds::fnv1a(key, len < SubTexture::KEY_LENGTH ? len : SubTexture::KEY_LENGTH) };
+}
+
 struct TextureAtlas {
 	static constexpr uint32_t INVALID_IDX = UINT32_MAX;
 	static constexpr int NUM_CHANNELS = 4;    // RGBA, this is hardcoded for now
-	static constexpr int MAX_SUBTEXTURES = 128;
+	static constexpr int MAX_SUBTEXTURES = 4096;    // only reserves address space, see tds::ArenaArray
+	static constexpr int MAX_DECODE_THREADS = 31;    // pack_atlas decodes on the calling thread and up to this many more
+	// NOTE: render commands keep the page in 4 bits (see RenderCmd::PAGE_SHIFT)
+	static constexpr int MAX_PAGES = 16;
 	
+	// w and h are the size of a page, the atlas starts out as one page and pack_atlas adds more when they fill up
 	void create(int w, int h);
 	void destroy();
 
+	// sprites are packed a group at a time. A group that doesn't fit in what's left of the current page
+	// starts a new page instead of getting split up, unless it can't fit on an empty page either.
+	// Only sprites that are bigger than a page (or don't fit in MAX_PAGES) end up with no place, which gets reported
 	void pack_atlas();
 
+	// sprites added while this is set get packed together, so things that get drawn together can stay on
+	// the same page (and in the same draw call)
+	uint8_t group = 0;
+
+	// how many threads pack_atlas decodes the images on, counting the calling one. 0 is one per logical core
+	// NOTE: the decode is meant to scale with cores, but so far it has only been timed on a single core machine,
+	// --bench-load <runs> --bench-threads <n> is there to check it on a bigger one
+	int decodeThreads = 0;
+
 	// key can be null, in that case it'll just autogenerate a key from the texture idx
+	// the files are only hashed here (see load_cooked), the image and json get loaded when the atlas is packed
 	uint32_t add_to_atlas(const char* key, const char* path, const char* jsonPath = nullptr);
-	
-	// does a linear search, gets the index of the sprite with the key
-	// do not use this in the main game loop, it is better to use it to cache a sprite when loading a gameobject
-	uint32_t find_sprite(const char* key) const;
 
+	// adds an empty (transparent) w x h sprite, for things that get drawn into the atlas data after packing
+	// if the atlas couldn't fit it, the SubTexture's x and y are left at -1
+	uint32_t reserve_sprite(const char* key, int w, int h);
+	
+	// index of the sprite with the key, or INVALID_IDX. Both are a hash table lookup, so they're fine to use in the game loop
+	// if two sprites have the same key, the first one added is the one that's found
+	uint32_t find(SpriteKey key) const;
+	uint32_t find_sprite(const char* key) const;    // for keys that come from data, hashes key first
+
+
+	//
+	// Cooked atlas
+	//
+	// Every file, key and reserved size that goes into the atlas gets hashed as it's added. A cooked atlas is the
+	// packed result (pixels, SubTexture rects and keys, SpriteSheets) saved with that hash, so as long as none of
+	// the inputs change, load_cooked replaces decoding, json parsing and packing with one mapped file:
+	//
+	//	if (!atlas.load_cooked(path)) {
+	//		atlas.pack_atlas();
+	//		... draw into the atlas ...
+	//		atlas.save_cooked(path);
+	//	}
+	static constexpr uint32_t COOKED_VERSION = 2;
+
+	// for files the atlas pixels depend on that aren't added to it, e.g. the levels GameWorld::bake_tiles draws
+	void add_cook_input(const char* path);
+	// returns false if there's no cooked atlas or it was cooked from different inputs, the atlas is untouched then
+	bool load_cooked(const char* path);
+	bool save_cooked(const char* path) const;
+
+	uint64_t inputHash = 0;
 
 	bool isPacked = false;
+	bool isCooked = false;    // packed by load_cooked, so anything that was drawn into it before saving already is
 
-	int width = -1, height = -1;
-	int nSubtextures = -1;
+	int width = -1, height = -1;    // of a page
+	int nPages = 0;
 
+	// every page back to back, a page is width * height pixels
 	void* data = nullptr;
-	SubTexture subTextures[MAX_SUBTEXTURES];
+	void* page_data(int page) const { assert(data); return static_cast<uint8_t*>(data) + page_bytes() * page; }
+	size_t page_bytes() const { return static_cast<size_t>(width) * height * NUM_CHANNELS; }
+
+	tds::ArenaArray<SubTexture> subTextures;
+
+	//
+	// Indexed copy of the atlas
+	//
+	// Every pixel of the atlas as a byte, indexing into one of the palettes. Every palette has the same 256 slots,
+	// so swapping a sprite's palette at draw time just means reading its indices through a different table.
+	// Slot 0 is always transparent (0x00000000)
+	// NOTE: the palette is shared by the whole atlas instead of being per sprite, because render commands only know
+	// where in the atlas they read from and not which sprite that is. NES art doesn't come close to 255 colors anyway
+	static constexpr uint32_t PALETTE_SIZE = 256;
+	static constexpr uint32_t MAX_PALETTES = 255;
+	static constexpr uint16_t BASE_PALETTE = 0;    // the atlas' own colors
+
+	struct Palette {
+		uint32_t colors[PALETTE_SIZE];    // RGBA8, packed the same way as data
+		SDL_FColor tint;    // for palettes made with add_tinted_palette, so backends that can't swap palettes can fake it
+		bool tintOnly;    // false for add_palette_swap, faking those with the tint would draw the base colors
+	};
+
+	uint8_t* indexedData = nullptr;    // laid out like data, a page is width * height bytes
+	bool indexedExact = false;    // every color made it into the base palette as it is
+	tds::ArenaArray<Palette> palettes;
+
+	// call once nothing else will be drawn into the atlas (after packing and GameWorld::bake_tiles)
+	// if the atlas has more than 255 colors, they get merged by dropping low bits until they fit (and we complain about it)
+	void build_indexed();
+	// once the pages are uploaded (Gfx::upload_atlas) the indexed copy is all that's left to read, so this gives back the
+	// RGBA pages and the atlas only takes a quarter of the memory. Only when the indexed copy is exact, returns whether it did
+	// NOTE: data and page_data can't be used after this
+	bool release_rgba();
+
+	// palette swaps, these return the palette's index (or BASE_PALETTE if we're out of palettes)
+	// tinted multiplies every color of the base palette, exactly what drawing with that color would have done
+	uint16_t add_tinted_palette(const SDL_FColor& tint);
+	// replaces the colors in from (RGBA8, as stored in data) with the ones in to
+	uint16_t add_palette_swap(const uint32_t* from, const uint32_t* to, int n);
 private:
+	void _load_sources();
+	static int _decode_worker(void* queue);
 	void _move_subtex_to_atlas(int idx);
+	void _hash_input(const void* data, size_t len);
+	void _index_key(uint32_t idx);
+	bool _add_page();
+	void _drop_subtex(SubTexture& subtex);
+	tds::ArenaMap<uint64_t, uint32_t> spriteLookup;    // hash of the key -> index into subTextures
 	mems::Arena arena;
+	mems::Arena pageArena;    // only pages go in here, so they stay contiguous as more get added
+	mems::Arena pathArena;    // source paths, they're dropped once the sources are loaded
 };
 
 //
@@ -10,11 +10,10 @@ namespace nes {
 	NSF::~NSF() { cleanup(); }
 
 	void NSF::cleanup() {
-		if (programData) {
-			delete[] programData;
-			programData = nullptr;
-			mValid = false;
-		}
+		mems::unmap_file(file);
+		programData = nullptr;
+		programLength = 0;
+		mValid = false;
 	}
 
 	uint16_t make_word(uint8_t lo, uint8_t hi) {
@@ -26,34 +25,25 @@ namespace nes {
 	}
 
 	bool NSF::load(const char* path) {
-		mValid = false;
+		cleanup();
 
-		FILE* fp = fopen(path, "rb");
-		if (!fp) return false;
-
-		fseek(fp, 0, SEEK_END);
-		size_t fileSize = ftell(fp);
-		if (fileSize < 0x80) {
+		if (!mems::map_file(file, path)) return false;
+		if (file.size < 0x80) {
 			// file doesn't even have the size of a full header in it
-			fclose(fp);
-			return false;
-		}
-		fseek(fp, 0, SEEK_SET);
-
-		char* buffer = new char[fileSize];
-		if (1 != fread(buffer, fileSize, 1, fp)) {
-			fclose(fp);
-			delete[] buffer;
+			cleanup();
 			return false;
 		}
-		fclose(fp);
 
-		char* bufPtr = buffer;
+		// the header is decoded straight from the mapping, and the program data is never copied
+		const char* buffer = static_cast<const char*>(file.data);
+		const char* bufPtr = buffer;
 
 		// validate header
 		constexpr char C_HEADER[5] = { 'N', 'E', 'S', 'M', 0x1A };
-		if (0 != memcmp(bufPtr, C_HEADER, 5))
-			goto nsf_load_fail_and_free;
+		if (0 != memcmp(bufPtr, C_HEADER, 5)) {
+			cleanup();
+			return false;
+		}
 
 		bufPtr += 5;
 		version = static_cast<uint8_t>(*(bufPtr++));
@@ -89,21 +79,13 @@ namespace nes {
 		programLength = make_3byte(bufPtr[0], bufPtr[1], bufPtr[2]);
 		bufPtr += 3;
 
-		if (programLength == 0) {
-			programLength = static_cast<uint32_t>(fileSize) - 0x80;
-			programData = new uint8_t[programLength];
-			memcpy(programData, buffer + 0x80, programLength);
-		}
-		else {
-			programData = new uint8_t[programLength];
-			memcpy(programData, buffer + 0x80, programLength);
-		}
+		// a length of 0 means the program data runs to the end of the file
+		const uint32_t available = static_cast<uint32_t>(file.size) - 0x80;
+		if (programLength == 0 || programLength > available)
+			programLength = available;
 
-		delete[] buffer;
+		programData = reinterpret_cast<const uint8_t*>(buffer + 0x80);
+		mValid = true;
 		return true;
-
-nsf_load_fail_and_free:
-		delete[] buffer;
-		return false;
 	}
 }
\ No newline at end of file
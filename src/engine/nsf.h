@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <mems.hpp>
 
 namespace nes {
 	struct NSF {
@@ -56,7 +57,11 @@ namespace nes {
 			NSF2_APPEND_NSFE = 1 << 7,    // NSFe will not be supported
 		} nsf2FeatureFlags = NSF2_NONE;
 
+		// programData points straight into the mapped file, so it's only valid until cleanup()
 		uint32_t programLength = 0;
-		uint8_t* programData = nullptr;
+		const uint8_t* programData = nullptr;
+
+	private:
+		mems::MappedFile file;
 	};
 }
@@ -0,0 +1,124 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "profiler.h"
+
+#include <string.h>
+
+#include <tinydef.hpp>
+
+#include "engine/gfx.h"
+
+Profiler profiler;
+
+uint32_t Profiler::register_zone(const char* name) {
+	for (uint32_t i = 0; i < nZones; i++) {
+		if (strncmp(zones[i].name, name, NAME_LENGTH - 1) == 0) return i;
+	}
+
+	// NOTE: this runs in release builds too, a profiler that runs out of zones should only get less precise
+	if (nZones >= OVERFLOW_ZONE) {
+		if (nZones == OVERFLOW_ZONE) {
+			Zone& other = zones[OVERFLOW_ZONE];
+			strncpy(other.name, "(other)", NAME_LENGTH - 1);
+			other.depth = 0;
+			nZones = MAX_ZONES;
+		}
+		fprintf(stderr, "Profiler ran out of zones, %.15s gets counted as (other)\n", name);
+		return OVERFLOW_ZONE;
+	}
+
+	Zone& zone = zones[nZones];
+	strncpy(zone.name, name, NAME_LENGTH - 1);
+	zone.name[NAME_LENGTH - 1] = '\0';
+	zone.depth = depth;
+	return nZones++;
+}
+
+void Profiler::begin_frame() {
+	memset(&current, 0, sizeof(current));
+	frameStart = SDL_GetPerformanceCounter();
+}
+
+void Profiler::end_frame() {
+	current.ticks = SDL_GetPerformanceCounter() - frameStart;
+
+	const uint64_t n = nFrames.load(std::memory_order_relaxed);
+	frames[n % HISTORY] = current;
+	nFrames.store(n + 1, std::memory_order_release);
+}
+
+void Profiler::draw_overlay(Gfx& gfx) const {
+	const uint64_t n = nFrames.load(std::memory_order_acquire);
+	const uint32_t nKept = static_cast<uint32_t>(tim::min<uint64_t>(n, HISTORY));
+	if (nKept == 0) return;
+
+	const double ticksToUs = 1e6 / static_cast<double>(SDL_GetPerformanceFrequency());
+
+	uint64_t frameSum = 0;
+	uint64_t zoneSums[MAX_ZONES] = {};
+	for (uint32_t i = 0; i < nKept; i++) {
+		const FrameRecord& frame = frames[i];
+		frameSum += frame.ticks;
+		for (uint32_t z = 0; z < nZones; z++) zoneSums[z] += frame.zoneTicks[z];
+	}
+
+	const uint8_t prevLayer = gfx.layer;
+	gfx.layer = Gfx::LAYER_HUD;
+
+	// NOTE: the values go through queue_counter, so a line only costs a few digit swaps when its average changes
+	constexpr int X = 4, Y = 16;
+	gfx.queue_rect(SDL_FRect{ X - 2.0f, Y - 2.0f, 8.0f * 28 + 4.0f, 8.0f * (nZones + 2) + 4.0f }, false, SDL_FColor{ 0.0f, 0.0f, 0.0f, 0.6f });
+	gfx.queue_text(X, Y, "zone         avg us");
+	gfx.queue_counter(X, Y + 8, "frame            ", static_cast<int>(static_cast<double>(frameSum) * ticksToUs / nKept));
+	for (uint32_t z = 0; z < nZones; z++) {
+		// indented by nesting and padded so the numbers line up
+		char label[2 * 3 + NAME_LENGTH + 2];
+		const int indent = tim::min(zones[z].depth, 3) * 2;
+		snprintf(label, sizeof(label), "%*s%-*s ", indent, "", NAME_LENGTH - indent, zones[z].name);
+		gfx.queue_counter(X, Y + 8 * (z + 2), label, static_cast<int>(static_cast<double>(zoneSums[z]) * ticksToUs / nKept));
+	}
+
+	// frame time graph of the last GRAPH_FRAMES frames, one pixel per frame, newest on the right
+	constexpr int GRAPH_FRAMES = 128, GRAPH_HEIGHT = 48;
+	constexpr float BUDGET_MS = 1000.0f / 60.0f;
+	constexpr float PX_PER_MS = 24.0f / BUDGET_MS;    // a whole 60 fps frame is half the graph
+	constexpr float GRAPH_X = Gfx::nesWidth - GRAPH_FRAMES - 4.0f, GRAPH_BOTTOM = Gfx::nesHeight - 4.0f;
+
+	gfx.queue_rect(SDL_FRect{ GRAPH_X, GRAPH_BOTTOM - GRAPH_HEIGHT, GRAPH_FRAMES, GRAPH_HEIGHT }, false, SDL_FColor{ 0.0f, 0.0f, 0.0f, 0.6f });
+	const uint32_t nBars = tim::min<uint32_t>(nKept, GRAPH_FRAMES);
+	for (uint32_t i = 0; i < nBars; i++) {
+		const FrameRecord& frame = frames[(n - nBars + i) % HISTORY];
+		const float ms = static_cast<float>(static_cast<double>(frame.ticks) * ticksToUs / 1000.0);
+		const float h = tim::min(ms * PX_PER_MS, static_cast<float>(GRAPH_HEIGHT));
+		const SDL_FColor color = ms <= BUDGET_MS ? SDL_FColor{ 0.2f, 0.8f, 0.2f, 1.0f } : SDL_FColor{ 0.9f, 0.2f, 0.2f, 1.0f };
+		gfx.queue_rect(SDL_FRect{ GRAPH_X + GRAPH_FRAMES - nBars + i, GRAPH_BOTTOM - h, 1.0f, h }, false, color);
+	}
+	gfx.queue_rect(SDL_FRect{ GRAPH_X, GRAPH_BOTTOM - BUDGET_MS * PX_PER_MS, GRAPH_FRAMES, 1.0f }, false, SDL_FColor{ 1.0f, 1.0f, 1.0f, 1.0f });
+
+	gfx.layer = prevLayer;
+}
+
+bool Profiler::dump_csv(const char* path) const {
+	::FILE* fp = fopen(path, "w");
+	if (!fp) {
+		fprintf(stderr, "Could not open %s for the profiler csv\n", path);
+		return false;
+	}
+
+	fprintf(fp, "frame,frame_ms");
+	for (uint32_t z = 0; z < nZones; z++) fprintf(fp, ",%s_ms", zones[z].name);
+	fprintf(fp, "\n");
+
+	const double ticksToMs = 1e3 / static_cast<double>(SDL_GetPerformanceFrequency());
+	const uint64_t n = nFrames.load(std::memory_order_acquire);
+	const uint64_t first = n > HISTORY ? n - HISTORY : 0;
+	for (uint64_t f = first; f < n; f++) {
+		const FrameRecord& frame = frames[f % HISTORY];
+		fprintf(fp, "%llu,%.4f", static_cast<unsigned long long>(f), static_cast<double>(frame.ticks) * ticksToMs);
+		for (uint32_t z = 0; z < nZones; z++) fprintf(fp, ",%.4f", static_cast<double>(frame.zoneTicks[z]) * ticksToMs);
+		fprintf(fp, "\n");
+	}
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+#include <SDL3/SDL_timer.h>
+
+// Frame profiler
+// PROFILE_ZONE("name") times the rest of the scope it's in, calls to the same zone in one frame add up and
+// zones that run inside other zones count towards both (times are inclusive).
+// The main loop calls begin_frame/end_frame, and every finished frame is kept in a ring of the last HISTORY frames
+struct Profiler {
+	static constexpr uint32_t MAX_ZONES = 32;
+	static constexpr uint32_t HISTORY = 256;
+	static constexpr int NAME_LENGTH = 16;
+	static constexpr uint32_t OVERFLOW_ZONE = MAX_ZONES - 1;    // once the others are taken, every new zone adds up in here
+
+	struct Zone {
+		char name[NAME_LENGTH];
+		int depth;    // how deep it was nested the first time it ran, only used to indent the overlay
+	};
+
+	struct FrameRecord {
+		uint64_t ticks;    // begin_frame to end_frame, in SDL_GetPerformanceCounter ticks
+		uint64_t zoneTicks[MAX_ZONES];
+	};
+
+	bool showOverlay = false;
+
+	uint32_t nZones = 0;
+	Zone zones[MAX_ZONES] = {};
+
+	// returns the id of the zone called name, registering it if it's the first time we see it
+	// (or OVERFLOW_ZONE, if there's no room left)
+	uint32_t register_zone(const char* name);
+
+	void begin_frame();
+	void end_frame();
+
+	// per zone averages and a graph of frame times over the kept frames, drawn on Gfx::LAYER_HUD
+	void draw_overlay(struct Gfx& gfx) const;
+
+	// one row per kept frame, oldest first, times in ms
+	bool dump_csv(const char* path) const;
+
+	// NOTE: only the main thread writes frames, and the next one it writes is frames[nFrames % HISTORY] (the oldest).
+	// So a reader on another thread can only use frames nFrames - HISTORY + 1 up to nFrames - 1 without locking,
+	// and only until the writer gets to them
+	std::atomic<uint64_t> nFrames = 0;
+	FrameRecord frames[HISTORY] = {};
+
+	// internal, used by ProfileZone
+	FrameRecord current = {};
+	uint64_t frameStart = 0;
+	int depth = 0;
+};
+
+extern Profiler profiler;
+
+struct ProfileZone {
+	uint32_t id;
+	uint64_t start;
+
+	ProfileZone(uint32_t id) : id(id), start(SDL_GetPerformanceCounter()) {
+		profiler.depth++;
+	}
+
+	~ProfileZone() {
+		profiler.current.zoneTicks[id] += SDL_GetPerformanceCounter() - start;
+		profiler.depth--;
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// the zone is only looked up by name the first time this line runs
+#define PROFILE_ZONE(name) \
+	static const uint32_t PROFILE_CONCAT(profileZoneId, __LINE__) = profiler.register_zone(name); \
+	ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(PROFILE_CONCAT(profileZoneId, __LINE__))
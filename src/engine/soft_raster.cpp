@@ -0,0 +1,359 @@
+#include "soft_raster.h"
+
+#include <SDL3/SDL_cpuinfo.h>
+
+#include <math.h>
+
+#include <tinydef.hpp>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define SOFT_RASTER_X86
+#include <immintrin.h>
+#endif
+
+// MSVC lets any function use any intrinsic, gcc and clang have to be told which functions get to use AVX2
+#if defined(SOFT_RASTER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SOFT_RASTER_AVX2 __attribute__((target("avx2")))
+#else
+#define SOFT_RASTER_AVX2
+#endif
+
+// NOTE: pixels are uint32_t with R in the lowest byte, which assumes a little endian cpu (so everything we ship on)
+static constexpr uint32_t ALPHA_MASK = 0xFF000000;
+static constexpr uint32_t WHITE = 0xFFFFFFFF;
+
+uint32_t SoftRaster::pack_color(const SDL_FColor& c) {
+	auto to_u8 = [](float f) { return static_cast<uint32_t>(tim::clamp(f, 0.0f, 1.0f) * 255.0f + 0.5f); };
+	return to_u8(c.r) | (to_u8(c.g) << 8) | (to_u8(c.b) << 16) | (to_u8(c.a) << 24);
+}
+
+//
+// SCALAR
+//
+// This is the reference for all the kernels below, they have to produce the exact same bytes.
+// It's also used for the leftover pixels at the end of each span
+
+// round(x / 255) for x in [0, 255 * 255], without the divide
+static inline uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t blend_px(uint32_t src, uint32_t dst, uint32_t color) {
+	uint32_t s[4];
+	for (int c = 0; c < 4; c++)
+		s[c] = div255(((src >> (c * 8)) & 0xFF) * ((color >> (c * 8)) & 0xFF));
+
+	const uint32_t invA = 255 - s[3];
+	uint32_t out = 0;
+	for (int c = 0; c < 4; c++) {
+		const uint32_t v = s[c] + div255(((dst >> (c * 8)) & 0xFF) * invA);
+		out |= tim::min(v, 255u) << (c * 8);
+	}
+	return out;
+}
+
+// step is 1 or -1, for flipped sprites src points at the rightmost texel and gets read backwards
+static void span_scalar(uint32_t* dst, const uint32_t* src, int n, int step, uint32_t color) {
+	for (int i = 0; i < n; i++, src += step)
+		dst[i] = blend_px(*src, dst[i], color);
+}
+
+// untextured geometry is the same as a white texel modulated by the color
+static void fill_scalar(uint32_t* dst, int n, uint32_t color) {
+	for (int i = 0; i < n; i++)
+		dst[i] = blend_px(WHITE, dst[i], color);
+}
+
+#ifdef SOFT_RASTER_X86
+//
+// SSE2
+//
+
+static inline __m128i div255_epu16(__m128i x) {
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// blend_px for 4 pixels, col is the color widened to 16 bits per channel (2 pixels worth)
+static inline __m128i blend4_sse2(__m128i src, __m128i dst, __m128i col) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi16(255);
+
+	const __m128i sLo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), col));
+	const __m128i sHi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), col));
+
+	// broadcast each pixel's alpha to all 4 of its channels
+	const __m128i invLo = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, 0xFF), 0xFF));
+	const __m128i invHi = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, 0xFF), 0xFF));
+
+	const __m128i dLo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), invLo));
+	const __m128i dHi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), invHi));
+
+	// packus saturates, which is the min(v, 255) from blend_px
+	return _mm_packus_epi16(_mm_add_epi16(sLo, dLo), _mm_add_epi16(sHi, dHi));
+}
+
+static inline __m128i load4_sse2(const uint32_t* src, int step) {
+	if (step > 0) return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+	return _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src - 3)), _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+static void span_sse2(uint32_t* dst, const uint32_t* src, int n, int step, uint32_t color) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m128i col = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color)), zero);
+	const bool modulated = color != WHITE;
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4, src += step * 4) {
+		const __m128i s = load4_sse2(src, step);
+		__m128i* d = reinterpret_cast<__m128i*>(dst + i);
+
+		if (!modulated) {
+			// alpha tested: opaque texels replace dst, fully clear texels (all zero) leave it alone,
+			// only groups with a texel in between need the full blend
+			const __m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask);
+			if (_mm_movemask_epi8(opaque) == 0xFFFF) {
+				_mm_storeu_si128(d, s);
+				continue;
+			}
+
+			const __m128i clear = _mm_cmpeq_epi32(s, zero);
+			if (_mm_movemask_epi8(_mm_or_si128(opaque, clear)) == 0xFFFF) {
+				const __m128i old = _mm_loadu_si128(d);
+				_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(opaque, s), _mm_andnot_si128(opaque, old)));
+				continue;
+			}
+		}
+
+		_mm_storeu_si128(d, blend4_sse2(s, _mm_loadu_si128(d), col));
+	}
+
+	span_scalar(dst + i, src, n - i, step, color);
+}
+
+static void fill_sse2(uint32_t* dst, int n, uint32_t color) {
+	const __m128i c = _mm_set1_epi32(static_cast<int>(color));
+	int i = 0;
+
+	if ((color & ALPHA_MASK) == ALPHA_MASK) {
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), c);
+	} else {
+		const __m128i white = _mm_set1_epi32(-1);
+		const __m128i col = _mm_unpacklo_epi8(c, _mm_setzero_si128());
+		for (; i + 4 <= n; i += 4) {
+			__m128i* d = reinterpret_cast<__m128i*>(dst + i);
+			_mm_storeu_si128(d, blend4_sse2(white, _mm_loadu_si128(d), col));
+		}
+	}
+
+	fill_scalar(dst + i, n - i, color);
+}
+
+//
+// AVX2
+//
+
+static inline SOFT_RASTER_AVX2 __m256i div255_epu16_avx2(__m256i x) {
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+// same as blend4_sse2, the unpacks and packs work per 128 bit lane so the pixel order comes back out unchanged
+static inline SOFT_RASTER_AVX2 __m256i blend8_avx2(__m256i src, __m256i dst, __m256i col) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i full = _mm256_set1_epi16(255);
+
+	const __m256i sLo = div255_epu16_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(src, zero), col));
+	const __m256i sHi = div255_epu16_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(src, zero), col));
+
+	const __m256i invLo = _mm256_sub_epi16(full, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sLo, 0xFF), 0xFF));
+	const __m256i invHi = _mm256_sub_epi16(full, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sHi, 0xFF), 0xFF));
+
+	const __m256i dLo = div255_epu16_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero), invLo));
+	const __m256i dHi = div255_epu16_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero), invHi));
+
+	return _mm256_packus_epi16(_mm256_add_epi16(sLo, dLo), _mm256_add_epi16(sHi, dHi));
+}
+
+SOFT_RASTER_AVX2 static void span_avx2(uint32_t* dst, const uint32_t* src, int n, int step, uint32_t color) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	const __m256i col = _mm256_unpacklo_epi8(_mm256_set1_epi32(static_cast<int>(color)), zero);
+	const bool modulated = color != WHITE;
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8, src += step * 8) {
+		const __m256i s = step > 0
+			? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src))
+			: _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src - 7)), reverse);
+		__m256i* d = reinterpret_cast<__m256i*>(dst + i);
+
+		if (!modulated) {
+			const __m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask), alphaMask);
+			if (_mm256_movemask_epi8(opaque) == -1) {
+				_mm256_storeu_si256(d, s);
+				continue;
+			}
+
+			const __m256i clear = _mm256_cmpeq_epi32(s, zero);
+			if (_mm256_movemask_epi8(_mm256_or_si256(opaque, clear)) == -1) {
+				_mm256_storeu_si256(d, _mm256_blendv_epi8(_mm256_loadu_si256(d), s, opaque));
+				continue;
+			}
+		}
+
+		_mm256_storeu_si256(d, blend8_avx2(s, _mm256_loadu_si256(d), col));
+	}
+
+	// NOTE: the rest of the program is legacy sse encoded, and running that with the upper halves of the ymm registers dirty
+	// is really slow on some intel cpus (this kernel was slower than scalar without it). Compilers usually do this for us
+	// on return, but not when the tail call below gets turned into a jump
+	_mm256_zeroupper();
+	span_sse2(dst + i, src, n - i, step, color);
+}
+#endif
+
+struct KernelTable {
+	void (*span)(uint32_t* dst, const uint32_t* src, int n, int step, uint32_t color);
+	void (*fill)(uint32_t* dst, int n, uint32_t color);
+};
+
+// indexed by SoftRaster::Kernels
+static const KernelTable kernelTables[] = {
+	{ span_scalar, fill_scalar },
+#ifdef SOFT_RASTER_X86
+	{ span_sse2, fill_sse2 },
+	{ span_avx2, fill_sse2 },
+#endif
+};
+
+void SoftRaster::init(int w, int h) {
+	width = w;
+	height = h;
+
+	const size_t size = sizeof(uint32_t) * static_cast<size_t>(w) * h;
+	const size_t spanSize = sizeof(uint32_t) * static_cast<size_t>(w);
+	arena.alloc(size + spanSize + 1, "SoftRaster");    // push needs to stay strictly under capacity
+	pixels = static_cast<uint32_t*>(arena.push_zero(size));
+	spanTexels = static_cast<uint32_t*>(arena.push(spanSize));
+
+	kernels = SCALAR;
+#ifdef SOFT_RASTER_X86
+	kernels = SDL_HasAVX2() ? AVX2 : SSE2;
+#endif
+}
+
+void SoftRaster::cleanup() {
+	arena.dealloc();
+	pixels = nullptr;
+	spanTexels = nullptr;
+	texture = nullptr;
+	indexedTexture = nullptr;
+}
+
+void SoftRaster::set_texture(const void* data, int w, int h) {
+	texture = static_cast<const uint32_t*>(data);
+	texWidth = w;
+	texHeight = h;
+}
+
+void SoftRaster::set_indexed_texture(const uint8_t* data, int w, int h) {
+	indexedTexture = data;
+	texWidth = w;
+	texHeight = h;
+}
+
+void SoftRaster::clear(const SDL_FColor& color) {
+	const uint32_t c = pack_color(color);
+	const int count = width * height;
+	for (int i = 0; i < count; i++) pixels[i] = c;
+}
+
+void SoftRaster::draw_quads(const SDL_Vertex* verts, uint32_t nQuads, bool textured, const uint32_t* palette) {
+	assert(!textured || !indexedTexture || palette);
+	for (uint32_t i = 0; i < nQuads; i++)
+		_draw_quad(verts + i * 4, textured, palette);
+}
+
+const char* SoftRaster::kernels_name(Kernels k) {
+	switch (k) {
+	case SSE2: return "SSE2";
+	case AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+void SoftRaster::_draw_quad(const SDL_Vertex* quad, bool textured, const uint32_t* palette) {
+	const SDL_FPoint p0 = quad[0].position;
+	const SDL_FPoint p1 = quad[2].position;
+
+	// a pixel gets drawn when its center is inside the quad, same rule as the gpu
+	const int x0 = tim::max(static_cast<int>(ceilf(p0.x - 0.5f)), 0);
+	const int x1 = tim::min(static_cast<int>(ceilf(p1.x - 0.5f)), width);
+	const int y0 = tim::max(static_cast<int>(ceilf(p0.y - 0.5f)), 0);
+	const int y1 = tim::min(static_cast<int>(ceilf(p1.y - 0.5f)), height);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	const uint32_t color = pack_color(quad[0].color);
+	const KernelTable& k = kernelTables[kernels];
+	const int n = x1 - x0;
+
+	const bool indexed = indexedTexture != nullptr;
+	if (!textured || (texture == nullptr && !indexed)) {
+		for (int y = y0; y < y1; y++)
+			k.fill(pixels + y * width + x0, n, color);
+		return;
+	}
+
+	// back from normalized coords to texels
+	const float tx0 = quad[0].tex_coord.x * texWidth;
+	const float ty0 = quad[0].tex_coord.y * texHeight;
+	const float stepX = (quad[2].tex_coord.x * texWidth - tx0) / (p1.x - p0.x);
+	const float stepY = (quad[2].tex_coord.y * texHeight - ty0) / (p1.y - p0.y);
+
+	// sample at the pixel centers
+	const float firstTx = tx0 + (x0 + 0.5f - p0.x) * stepX;
+	const int step = stepX > 0.0f ? 1 : -1;
+	const int texel0 = static_cast<int>(floorf(firstTx));
+	const int texelLast = texel0 + step * (n - 1);
+
+	// unscaled sprites (so everything right now) go through the span kernels, anything else is sampled pixel by pixel
+	const bool unscaled = fabsf(fabsf(stepX) - 1.0f) < 0.0001f
+		&& texel0 >= 0 && texel0 < texWidth
+		&& texelLast >= 0 && texelLast < texWidth;
+
+	for (int y = y0; y < y1; y++) {
+		const int ty = tim::clamp(static_cast<int>(floorf(ty0 + (y + 0.5f - p0.y) * stepY)), 0, texHeight - 1);
+		uint32_t* dst = pixels + y * width + x0;
+
+		if (indexed) {
+			// a quarter of the texture reads, the palette is 1kb so it just sits in L1
+			const uint8_t* row = indexedTexture + ty * texWidth;
+			if (unscaled) {
+				const uint8_t* src = row + texel0;
+				for (int x = 0; x < n; x++, src += step) spanTexels[x] = palette[*src];
+				k.span(dst, spanTexels, n, 1, color);
+			} else {
+				for (int x = 0; x < n; x++) {
+					const int tx = tim::clamp(static_cast<int>(floorf(firstTx + x * stepX)), 0, texWidth - 1);
+					dst[x] = blend_px(palette[row[tx]], dst[x], color);
+				}
+			}
+			continue;
+		}
+
+		const uint32_t* row = texture + ty * texWidth;
+		if (unscaled) {
+			k.span(dst, row + texel0, n, step, color);
+		} else {
+			for (int x = 0; x < n; x++) {
+				const int tx = tim::clamp(static_cast<int>(floorf(firstTx + x * stepX)), 0, texWidth - 1);
+				dst[x] = blend_px(row[tx], dst[x], color);
+			}
+		}
+	}
+}
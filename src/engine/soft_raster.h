@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <SDL3/SDL_render.h>
+
+#include <mems.hpp>
+
+// CPU rasterizer for Gfx::SOFTWARE
+// It draws the same quads the SDL_Renderer backend batches (see Gfx::_push_quad) into a small RGBA framebuffer,
+// so the only thing that has to go through SDL_Renderer each frame is one texture upload.
+//
+// Pixels are packed the same way as the atlas (R, G, B, A in memory), and blending matches
+// SDL_BLENDMODE_BLEND_PREMULTIPLIED with the vertex color modulating the texel: out = src * col + dst * (1 - srcA * colA)
+struct SoftRaster {
+	enum Kernels {
+		SCALAR,
+		SSE2,
+		AVX2,
+	};
+
+	int width = 0, height = 0;
+	uint32_t* pixels = nullptr;
+	Kernels kernels = SCALAR;    // picked in init from what the cpu supports
+
+	void init(int w, int h);
+	void cleanup();
+
+	// the texture isn't copied, so it has to stay alive while drawing
+	void set_texture(const void* data, int w, int h);
+	// same, but a byte per texel that gets looked up in the palette passed to draw_quads (see TextureAtlas::indexedData)
+	// when this is set, it's used instead of the RGBA texture
+	void set_indexed_texture(const uint8_t* data, int w, int h);
+
+	void clear(const SDL_FColor& color);
+
+	// verts are quads as laid out by Gfx::_push_quad (top left, top right, bottom right, bottom left)
+	// and only axis aligned quads are supported, which is the only thing Gfx ever makes
+	// palette (256 RGBA8 colors) is required for textured quads when the texture is indexed
+	void draw_quads(const SDL_Vertex* verts, uint32_t nQuads, bool textured, const uint32_t* palette = nullptr);
+
+	static const char* kernels_name(Kernels k);
+
+	// RGBA8, packed the same way as pixels
+	static uint32_t pack_color(const SDL_FColor& color);
+
+private:
+	const uint32_t* texture = nullptr;
+	const uint8_t* indexedTexture = nullptr;
+	int texWidth = 0, texHeight = 0;
+	uint32_t* spanTexels = nullptr;    // a row of indexed texels looked up in the palette, so the span kernels can blend it
+	mems::Arena arena;
+
+	void _draw_quad(const SDL_Vertex* quad, bool textured, const uint32_t* palette);
+};
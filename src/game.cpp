@@ -10,67 +10,164 @@
 #include "engine/game_context.h"
 #include "engine/image_asset.h"
 #include "engine/audio.h"
+#include "engine/profiler.h"
 
 #include "game/player.h"
 #include "game/enemy.h"
+#include "game/projectile.h"
 #include "game/world.h"
 
-#include <vector>
+#include <SDL3/SDL_cpuinfo.h>
+
 #include <tinydef.hpp>
+#include <mems.hpp>
 
 extern Input input;
 extern Gfx gfx;
 extern TextureAtlas atlas;
 extern GameWorld world;
+extern mems::Arena entityArena;
 extern Player player;
-extern std::vector<Enemy> enemies;
+extern tds::Pool<Enemy> enemies;
+extern tds::Pool<Projectile> playerProjectiles;
+extern tds::Pool<Projectile> enemyProjectiles;
 extern GameContext game;
 
-void game_init() { 
+static constexpr const char* WORLD_PATH = "./res/world1.ldtk";
+static constexpr const char* COOKED_ATLAS_PATH = "./res/atlas.cooked";
+
+// loads the world and queues every asset into a new atlas, nothing is decoded or packed yet
+// returns the font's sprite index
+static uint32_t load_world_and_sources(GameWorld& world, TextureAtlas& atlas) {
 	// load world (this happens before atlas creation because we need to prepare relPaths of the tilesets)
-	world.init("./res/world1.ldtk");
+	world.init(WORLD_PATH);
 
 	// create atlas and load all assets
 	atlas.create(1024, 1024);
-	gfx.fontIdx = atlas.add_to_atlas("font", "./res/font.png");
+	const uint32_t fontIdx = atlas.add_to_atlas("font", "./res/font.png");
 	atlas.add_to_atlas("player", "./res/mainChar/mage3.png", "./res/mainChar/mage3.json");
 	atlas.add_to_atlas("enemy1", "./res/enemy1/enemy1.png", "./res/enemy1/enemy1.json");
 	atlas.add_to_atlas("projectile1", "./res/fireball1/fireball1.png", "./res/fireball1/fireball1.json");
+	// the levels get their own group, so when the atlas spills onto another page the entities and font stay together
+	atlas.group = 1;
 	world.load_assets(atlas);
-	atlas.pack_atlas();
+	atlas.group = 0;
+	atlas.add_cook_input(WORLD_PATH);    // bake_tiles draws the levels into the atlas
+	return fontIdx;
+}
+
+void game_init() { 
+	gfx.fontIdx = load_world_and_sources(world, atlas);
+
+	// nothing has been decoded yet, if none of the files changed since the last cook this skips all of it
+	const bool cooked = atlas.load_cooked(COOKED_ATLAS_PATH);
+	if (!cooked) atlas.pack_atlas();
+	world.bake_tiles(atlas);
+	if (!cooked) atlas.save_cooked(COOKED_ATLAS_PATH);
+	atlas.build_indexed();
+	Enemy::detectedPalette = atlas.add_tinted_palette(SDL_FColor{ 1.0f, 0.5f, 0.5f, 1.0f });
 	gfx.upload_atlas(atlas);
+	atlas.release_rgba();    // past this the software backend only reads the indexed atlas, and the hardware one its textures
 
-	Enemy& enemy = enemies.emplace_back();
+	// entity pools, these never grow so we can size the arena pretty tightly
+	entityArena.alloc(1000 * 1000, "Entities");
+	enemies.init(entityArena, MAX_ENEMIES);
+	playerProjectiles.init(entityArena, NUM_ATTACKS);
+	enemyProjectiles.init(entityArena, MAX_ENEMIES * NUM_PROJECTILES);
 
 	// load gameobjects from texture atlas
 	// image assets are already loaded, the gameobjects simply just need to cache the indices of the assets they need
 	player.load(atlas);
-	for (int i = 0; i < enemies.size(); i++) enemies[i].load(atlas);
 
-	enemy.spawn(50.0f, 100.0f, 5.0f, 0.0f);
+	Enemy* enemy = enemies.spawn();
+	enemy->load(atlas);
+	enemy->spawn(50.0f, 100.0f, 5.0f, 0.0f);
+}
+
+// NOTE: always packs from scratch and never touches the cooked atlas, that's the part huge pages are meant to help with
+void game_bench_load(uint32_t runs, int decodeThreads, FILE* out) {
+	struct LoadTimes {
+		uint64_t loadNs, packNs, bakeNs;
+		uint64_t pageFaults;
+	};
+	LoadTimes times[2] = {};    // normal pages, huge pages
+
+	// alternating, so neither one always gets the warmer caches
+	for (uint32_t run = 0; run < runs * 2; run++) {
+		const int huge = run & 1;
+		mems::allowHugePages = huge != 0;
+		GameWorld benchWorld = {};
+		TextureAtlas benchAtlas = {};
+
+		const uint64_t faults = mems::get_page_faults();
+		const uint64_t start = SDL_GetTicksNS();
+		load_world_and_sources(benchWorld, benchAtlas);
+		benchAtlas.decodeThreads = decodeThreads;
+		const uint64_t loaded = SDL_GetTicksNS();
+		benchAtlas.pack_atlas();
+		const uint64_t packed = SDL_GetTicksNS();
+		benchWorld.bake_tiles(benchAtlas);
+		const uint64_t baked = SDL_GetTicksNS();
+
+		times[huge].loadNs += loaded - start;
+		times[huge].packNs += packed - loaded;
+		times[huge].bakeNs += baked - packed;
+		times[huge].pageFaults += mems::get_page_faults() - faults;
+
+		benchAtlas.destroy();
+		benchWorld.cleanup();
+	}
+	mems::allowHugePages = true;
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"runs\": %u,\n", runs);
+	fprintf(out, "\t\"decode_threads\": %d,\n", decodeThreads > 0 ? decodeThreads : SDL_GetNumLogicalCPUCores());
+	for (int huge = 0; huge < 2; huge++) {
+		const LoadTimes& t = times[huge];
+		const double n = runs ? static_cast<double>(runs) : 1.0;
+		fprintf(out, "\t\"%s\": { \"world_load_ms\": %.3f, \"pack_atlas_ms\": %.3f, \"bake_tiles_ms\": %.3f, \"page_faults\": %.1f }%s\n",
+			huge ? "huge_pages" : "normal_pages", t.loadNs / 1e6 / n, t.packNs / 1e6 / n, t.bakeNs / 1e6 / n, t.pageFaults / n, huge ? "" : ",");
+	}
+	fprintf(out, "}\n");
 }
 
 void update_process_rooms();
 void update_camera();
 
-void game_update() {
-	game.nEnemies = static_cast<int>(enemies.size());
-	game.enemies = enemies.data();
+// the camera moves on update like everything else, game_render interpolates gfx.cameraPos between these two
+static SDL_FPoint cameraPos = {}, prevCameraPos = {};
 
+void game_update() {
+	PROFILE_ZONE("game_update");
 	update_process_rooms();
 
 	// update entities
 	player.update(game);
-	for (int i = 0; i < enemies.size(); i++) enemies[i].update(game);
+
+	for (u32 i = 0; i < enemies.size;) {
+		enemies[i].update(game);
+		if (!enemies[i].active) enemies.despawn_at(i);
+		else i++;
+	}
+	Enemy::update_projectiles(game);
 
 	update_camera();
 }
 
 void game_render() {
+	PROFILE_ZONE("game_render");
+	gfx.cameraPos.x = prevCameraPos.x + (cameraPos.x - prevCameraPos.x) * game.alpha;
+	gfx.cameraPos.y = prevCameraPos.y + (cameraPos.y - prevCameraPos.y) * game.alpha;
+
+	gfx.layer = Gfx::LAYER_WORLD;
 	world.render(gfx, game);
-	player.render(gfx);
 
-	for (int i = 0; i < enemies.size(); i++) enemies[i].render(gfx);
+	gfx.layer = Gfx::LAYER_ENTITIES;
+	player.render(gfx, game.alpha);
+	for (Projectile& projectile : playerProjectiles) projectile.render(gfx, game.alpha);
+
+	for (Enemy& enemy : enemies) enemy.render(gfx, game.alpha);
+	for (Projectile& projectile : enemyProjectiles) projectile.render(gfx, game.alpha);
 }
 
 constexpr float CAM_SPEED = 7.5f;
@@ -102,11 +199,13 @@ void update_camera() {
 		targetY = tim::clamp(targetY, playerRoom->pxWorldY, playerRoom->pxHeight - Gfx::nesHeight);
 	}
 
-	gfx.cameraPos.x = tim::filerp32(gfx.cameraPos.x, static_cast<float>(targetX), CAM_SPEED, game.delta);
-	gfx.cameraPos.y = tim::filerp32(gfx.cameraPos.y, static_cast<float>(targetY), CAM_SPEED, game.delta);
+	prevCameraPos = cameraPos;
+	cameraPos.x = tim::filerp32(cameraPos.x, static_cast<float>(targetX), CAM_SPEED, game.delta);
+	cameraPos.y = tim::filerp32(cameraPos.y, static_cast<float>(targetY), CAM_SPEED, game.delta);
 }
 
 void update_process_rooms() {
+	PROFILE_ZONE("process rooms");
 	memset(game.processRooms, 0, sizeof(LdtkLevel*) * GameContext::NUM_PROCESS_ROOMS);
 	memset(game.playerRooms, 0, sizeof(LdtkLevel*) * GameContext::NUM_PROCESS_ROOMS);
 	game.nProcessRooms = 0;
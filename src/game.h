@@ -1,5 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+
 void game_init();
 void game_update();
 void game_render();
+
+// loads the world and packs the atlas runs times with huge pages and runs times without, and prints the averages as json
+// decodeThreads is TextureAtlas::decodeThreads, 0 for one per core
+void game_bench_load(uint32_t runs, int decodeThreads, FILE* out);
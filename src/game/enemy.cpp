@@ -9,18 +9,16 @@
 
 constexpr float enemySpeedX{ 20.0f };
 
+uint16_t Enemy::detectedPalette = TextureAtlas::BASE_PALETTE;
+
 void Enemy::load(const TextureAtlas& atlas) {
-	animator.init(atlas.find_sprite("enemy1"));
+	animator.init(atlas.find("enemy1"_sprite));
 	sheet = atlas.subTextures[animator.spriteIdx].sheetData;
 	assert(sheet);
 
 	origin = { 18.0f, 18.0f };
 	health = MAX_HEALTH;
 
-	for (int i = 0; i < NUM_PROJECTILES; i++) {
-		projectiles[i].load(atlas);
-	}
-
 	if (sheet->frames) {
 		collBoxSize = { static_cast<float>(sheet->frames[0].source.w), static_cast<float>(sheet->frames[0].source.h) };
 		origin = { collBoxSize.x / 2.0f, collBoxSize.y / 2.0f };
@@ -33,38 +31,26 @@ void Enemy::load(const TextureAtlas& atlas) {
 
 void Enemy::spawn(float x, float y, float vx, float vy) {
 	pos = { x, y };
+	prevPos = pos;
 	velocity = { vx, vy };
 	active = true;
 	detectedPlayer = false;
-
-	for (int i = 0; i < NUM_PROJECTILES; i++) {
-		projectiles[i].active = false;
-	}
+	movementTimer = 0.0f;
+	fireTimer = 0.0f;
+	nProjectiles = 0;
 }
 
 void Enemy::update(GameContext& ctx) {
 	if (!active) return;
 
-	movementTimer += ctx.delta;
-
-	// update projectiles
-	for (int i = 0; i < NUM_PROJECTILES; i++) {
-		projectiles[i].update(ctx);
-
-		if (projectiles[i].active) {
-			SDL_FRect projectile = projectiles[i].get_cboxf();
-			SDL_FRect player = ctx.player->get_cboxf();
-
-			// Check if enemy's projectile hit the player
-			if (SDL_HasRectIntersectionFloat(&projectile, &player)) {
-				ctx.player->health -= 1;
-				projectiles[i].active = false;
-				//printf("Player health: %i\n", ctx.player->health);
-			}
-		}
+	// the update loop despawns us once we're inactive
+	if (health <= 0) {
+		active = false;
+		return;
 	}
 
-	if (ctx.enemies->health <= 0 && ctx.enemies->active) ctx.enemies->active = false;
+	prevPos = pos;
+	movementTimer += ctx.delta;
 
 	// check if player is within the enemy's detection range
 	float dx = ctx.player->pos.x - pos.x;
@@ -83,14 +69,16 @@ void Enemy::update(GameContext& ctx) {
 		fireTimer += ctx.delta;
 
 		if (fireTimer >= FIRE_COOLDOWN) {
-			for (int i = 0; i < NUM_PROJECTILES; i++) {
-				if (!projectiles[i].active) {
-					if (velocity.x >= 0.0f && ctx.player->pos.x >= pos.x)
-						projectiles[i].spawn(pos.x, pos.y, 100.0f, 0.0f);
-					else if (velocity.x < 0.0f && ctx.player->pos.x < pos.x)
-						projectiles[i].spawn(pos.x, pos.y, -100.0f, 0.0f);
-
-					break;
+			const bool facingPlayer =
+				(velocity.x >= 0.0f && ctx.player->pos.x >= pos.x) ||
+				(velocity.x < 0.0f && ctx.player->pos.x < pos.x);
+
+			if (facingPlayer && nProjectiles < NUM_PROJECTILES) {
+				if (Projectile* projectile = ctx.enemyProjectiles->spawn()) {
+					projectile->load(*ctx.atlas);
+					projectile->spawn(pos.x, pos.y, velocity.x >= 0.0f ? 100.0f : -100.0f, 0.0f);
+					projectile->owner = ctx.enemies->handle_of(*this);
+					nProjectiles++;
 				}
 			}
 
@@ -114,20 +102,40 @@ void Enemy::update(GameContext& ctx) {
 	animator.update(ctx.delta, *sheet);
 }
 
-void Enemy::render(Gfx& gfx) {
+void Enemy::render(Gfx& gfx, float alpha) {
 	if (!active) return;
 
-	SDL_FColor enemyColor = { 1.0f, 1.0f, 1.0f, 1.0f };
-	
-	if (detectedPlayer) {
-		enemyColor.b = 0.5f;
-		enemyColor.g = 0.5f;
-		// by this point, enemyColor is equal to { 1.0f, 0.5f, 0.5f, 1.0f }
-	}
+	// spotting the player turns the enemy red, which is just a palette swap
+	const SDL_FPoint at = render_pos(alpha);
+	gfx.queue_sprite_palette(static_cast<int>(at.x - origin.x), static_cast<int>(at.y - origin.y), animator.spriteIdx,
+		detectedPlayer ? detectedPalette : TextureAtlas::BASE_PALETTE, animator.current_frame(*sheet));
+}
+
+void Enemy::update_projectiles(GameContext& ctx) {
+	tds::Pool<Projectile>& projectiles = *ctx.enemyProjectiles;
+	const SDL_FRect player = ctx.player->get_cboxf();
+
+	for (u32 i = 0; i < projectiles.size;) {
+		Projectile& cProjectile = projectiles[i];
+		cProjectile.update(ctx);
+
+		if (cProjectile.active) {
+			SDL_FRect projectile = cProjectile.get_cboxf();
+
+			// Check if enemy's projectile hit the player
+			if (SDL_HasRectIntersectionFloat(&projectile, &player)) {
+				ctx.player->health -= 1;
+				cProjectile.active = false;
+				//printf("Player health: %i\n", ctx.player->health);
+			}
+		}
+
+		if (!cProjectile.active) {
+			// the owner might have been despawned already, in which case nobody needs to know
+			if (Enemy* owner = ctx.enemies->get(cProjectile.owner))
+				owner->nProjectiles--;
 
-	gfx.queue_sprite(static_cast<int>(pos.x - origin.x), static_cast<int>(pos.y - origin.y), animator.spriteIdx, animator.current_frame(*sheet), true, enemyColor);
-	
-	for (int i = 0; i < NUM_PROJECTILES; i++) {
-		projectiles[i].render(gfx);
+			projectiles.despawn_at(i);
+		} else i++;
 	}
 }
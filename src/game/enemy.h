@@ -6,7 +6,8 @@
 #include "player.h"
 #include <tinydef.hpp>
 
-constexpr int NUM_PROJECTILES = 4;
+constexpr int NUM_PROJECTILES = 4;    // per enemy
+constexpr int MAX_ENEMIES = 32;
 
 struct Enemy : public Entity {
 	float movementTimer;
@@ -15,12 +16,18 @@ struct Enemy : public Entity {
 
 	void load(const struct TextureAtlas& atlas) override;
 	void update(struct GameContext& ctx) override;
-	void render(struct Gfx& gfx) override;
+	void render(struct Gfx& gfx, float alpha) override;
+
+	// updates every enemy projectile at once, since they all live in GameContext::enemyProjectiles
+	static void update_projectiles(struct GameContext& ctx);
+
+	// the atlas palette enemies are drawn with once they've spotted the player, set up by game_init
+	static uint16_t detectedPalette;
 	
 	int health = MAX_HEALTH;
 
 private:
-	Projectile projectiles[NUM_PROJECTILES];
+	int nProjectiles;
 
 	static constexpr float FIRE_COOLDOWN = 0.4f;
 	float fireTimer;
@@ -13,6 +13,10 @@ bool Entity::is_in_room(const LdtkLevel* level) {
 	return SDL_HasRectIntersectionFloat(&cbox, &lbox);
 }
 
+SDL_FPoint Entity::render_pos(float alpha) const {
+	return SDL_FPoint{ prevPos.x + (pos.x - prevPos.x) * alpha, prevPos.y + (pos.y - prevPos.y) * alpha };
+}
+
 SDL_FRect Entity::get_cboxf() {
 	return SDL_FRect{ pos.x - origin.x, pos.y - collBoxSize.y, collBoxSize.x, collBoxSize.y };
 }
\ No newline at end of file
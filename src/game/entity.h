@@ -10,7 +10,7 @@ constexpr SDL_FColor FCOL_WHITE = { 1.0f, 1.0f, 1.0f, 1.0f };
 struct Entity {
 	bool active = true;
 
-	SDL_FPoint prevPos;
+	SDL_FPoint prevPos;    // pos before the last update, so rendering can interpolate between fixed updates
 	SDL_FPoint pos;
 	SDL_FPoint origin;
 	SDL_FPoint collBoxSize;
@@ -21,8 +21,11 @@ struct Entity {
 
 	virtual void load(const TextureAtlas& atlas) = 0;
 	virtual void update(struct GameContext& ctx) = 0;
-	virtual void render(struct Gfx& gfx) = 0;
+	virtual void render(struct Gfx& gfx, float alpha) = 0;
 
 	bool is_in_room(const struct LdtkLevel* level);
 	SDL_FRect get_cboxf();
+
+	// where to draw the entity, alpha is how far we are from prevPos to pos (see GameContext::alpha)
+	SDL_FPoint render_pos(float alpha) const;
 };
\ No newline at end of file
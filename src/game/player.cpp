@@ -4,6 +4,7 @@
 #include "engine/image_asset.h"
 #include "engine/gfx.h"
 #include "engine/input.h"
+#include "engine/profiler.h"
 #include "game/enemy.h"
 
 #include "game/world.h"
@@ -13,18 +14,14 @@
 #include <tinydef.hpp>
 
 void Player::load(const TextureAtlas& atlas) {
-	animator.init(atlas.find_sprite("player"));
+	animator.init(atlas.find("player"_sprite));
 	sheet = atlas.subTextures[animator.spriteIdx].sheetData;
 	assert(sheet);
 
 	pos = { 64.0f, 130.0f };
+	prevPos = pos;
 	velocity = { 0.0f, 0.0f };
 
-	for (int i = 0; i < NUM_ATTACKS; i++) {
-		projectiles[i].load(atlas);
-		projectiles[i].active = false;
-	}
-
 	fireTimer = FIRE_COOLDOWN;
 	health = MAX_HEALTH;
 
@@ -54,16 +51,16 @@ void Player::update(GameContext& ctx) {
 		velocity.x = -hSpeed;
 	} else velocity.x = 0.0f;
 
+	tds::Pool<Projectile>& projectiles = *ctx.playerProjectiles;
 	if (ctx.input->b) {
 		if (fireTimer >= FIRE_COOLDOWN) {
-			for (int i = 0; i < NUM_ATTACKS; i++) {
-				if (!projectiles[i].active) {
-					constexpr float PROJECTILE_SPEED = 150.0f;
-					animator.start(AS_ATTACK, *sheet);
-					if (!facingLeft) projectiles[i].spawn(pos.x + 4, pos.y - 15.0f, PROJECTILE_SPEED, 0.0f);
-					else if (facingLeft) projectiles[i].spawn(pos.x - 4, pos.y - 15.0f, -PROJECTILE_SPEED, 0.0f);
-					break;
-				}
+			// the pool is sized to NUM_ATTACKS, so this fails once that many are in flight
+			if (Projectile* projectile = projectiles.spawn()) {
+				constexpr float PROJECTILE_SPEED = 150.0f;
+				animator.start(AS_ATTACK, *sheet);
+				projectile->load(*ctx.atlas);
+				if (!facingLeft) projectile->spawn(pos.x + 4, pos.y - 15.0f, PROJECTILE_SPEED, 0.0f);
+				else projectile->spawn(pos.x - 4, pos.y - 15.0f, -PROJECTILE_SPEED, 0.0f);
 			}
 
 			fireTimer = 0.0f;
@@ -71,25 +68,28 @@ void Player::update(GameContext& ctx) {
 	}
 	
 	// update projectiles
-	for (int i = 0; i < NUM_ATTACKS; i++) {
-		projectiles[i].update(ctx);
+	for (u32 i = 0; i < projectiles.size;) {
+		Projectile& cProjectile = projectiles[i];
+		cProjectile.update(ctx);
 
-		if (projectiles[i].active) {
-			SDL_FRect projectile = projectiles[i].get_cboxf();
-			for (int j = 0; j < ctx.nEnemies; j++) {
-				if (!ctx.enemies[j].active) continue;
+		if (cProjectile.active) {
+			SDL_FRect projectile = cProjectile.get_cboxf();
+			for (Enemy& cEnemy : *ctx.enemies) {
+				if (!cEnemy.active) continue;
 
-				SDL_FRect enemy = ctx.enemies[j].get_cboxf();
+				SDL_FRect enemy = cEnemy.get_cboxf();
 
 				if (SDL_HasRectIntersectionFloat(&projectile, &enemy)) {
-					ctx.enemies[j].health -= 1;
+					cEnemy.health -= 1;
 					ctx.points += 100;
 
-					projectiles[i].active = false;
+					cProjectile.active = false;
 				}
 			}
-
 		}
+
+		if (!cProjectile.active) projectiles.despawn_at(i);
+		else i++;
 	}
 
 	// apply gravity
@@ -123,13 +123,10 @@ void Player::update(GameContext& ctx) {
 	move_with_collision(ctx);
 }
 
-void Player::render(Gfx& gfx) {
-	gfx.queue_sprite(static_cast<int>(pos.x - origin.x), static_cast<int>(pos.y - origin.y),
+void Player::render(Gfx& gfx, float alpha) {
+	const SDL_FPoint at = render_pos(alpha);
+	gfx.queue_sprite(static_cast<int>(at.x - origin.x), static_cast<int>(at.y - origin.y),
 		animator.spriteIdx, animator.current_frame(*sheet), true, FCOL_WHITE, facingLeft);
-
-	for (int i = 0; i < NUM_ATTACKS; i++) {
-		projectiles[i].render(gfx);
-	}
 	
 	// const SDL_FRect cbox = get_cboxf();
 	// if (isGrounded) gfx.queue_rect(cbox, true, SDL_FColor{ 0.0f, 0.0f, 1.0f, 1.0f });
@@ -166,6 +163,7 @@ float line_overlap(float x0, float len0, float x1, float len1) {
 }
 
 void Player::move_with_collision(const GameContext& ctx) {
+	PROFILE_ZONE("move collision");
 	prevPos = pos;
 
 	// NOTE(sand): I'm going to try an approach where we keep track of how far we've moved from the previous position
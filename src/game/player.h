@@ -3,7 +3,7 @@
 #include "entity.h"
 #include "projectile.h"
 
-constexpr int NUM_ATTACKS = 6;
+constexpr int NUM_ATTACKS = 6;    // size of GameContext::playerProjectiles
 
 struct Player : Entity {
 	enum AState {
@@ -31,12 +31,9 @@ struct Player : Entity {
 
 	void load(const struct TextureAtlas& atlas) override;
 	void update(struct GameContext& ctx) override;
-	void render(struct Gfx& gfx) override;
+	void render(struct Gfx& gfx, float alpha) override;
 
 private:
-
-	Projectile projectiles[NUM_ATTACKS];
-
 	static constexpr float FIRE_COOLDOWN = 0.4f;
 	float fireTimer;
 
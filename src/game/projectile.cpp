@@ -9,6 +9,7 @@
 
 void Projectile::spawn(float x, float y, float vx, float vy) {
 	pos = SDL_FPoint(x, y);
+	prevPos = pos;
 	active = true;
 	lifeTimer = 0.0f;
 	velocity = { vx, vy };
@@ -16,7 +17,7 @@ void Projectile::spawn(float x, float y, float vx, float vy) {
 }
 
 void Projectile::load(const TextureAtlas& atlas) {
-	animator.init(atlas.find_sprite("projectile1"));
+	animator.init(atlas.find("projectile1"_sprite));
 	sheet = atlas.subTextures[animator.spriteIdx].sheetData;
 	assert(sheet);
 
@@ -26,6 +27,7 @@ void Projectile::load(const TextureAtlas& atlas) {
 
 void Projectile::update(GameContext& ctx) {
 	if (active) {
+		prevPos = pos;
 		lifeTimer += ctx.delta;
 
 		if (lifeTimer >= LIFETIME) {
@@ -40,10 +42,11 @@ void Projectile::update(GameContext& ctx) {
 	}
 }
 
-void Projectile::render(Gfx& gfx) {
+void Projectile::render(Gfx& gfx, float alpha) {
 	if (active) {
+		const SDL_FPoint at = render_pos(alpha);
 		gfx.queue_sprite(
-			static_cast<int>(pos.x - origin.x), static_cast<int>(pos.y - origin.y),
+			static_cast<int>(at.x - origin.x), static_cast<int>(at.y - origin.y),
 			animator.spriteIdx, animator.current_frame(*sheet), true, FCOL_WHITE,
 			velocity.x < 0.0f);
 	}
@@ -8,9 +8,12 @@ struct Projectile : public Entity {
 	void spawn(float x, float y, float vx, float vy);
 	void load(const struct TextureAtlas& atlas) override;
 	void update(struct GameContext& ctx) override;
-	void render(struct Gfx& gfx) override;
+	void render(struct Gfx& gfx, float alpha) override;
 	static constexpr float LIFETIME = 2.0f;     // our projectile will live for 1 second
 	float lifeTimer = 0.0f;
+
+	// whoever fired this projectile, this might be stale if the owner has died since
+	tds::PoolHandle owner;
 };
 
 #endif
\ No newline at end of file
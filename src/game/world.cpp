@@ -5,6 +5,9 @@
 #include "engine/gfx.h"
 
 #include <SDL3/SDL.h>
+#include <tinydef.hpp>
+
+#include <math.h>
 
 #include <simdjson.h>
 using namespace simdjson;
@@ -34,7 +37,7 @@ static inline const char* copy_to_arena(std::string_view str, mems::Arena& arena
 // NOTE(sand): the directory we are producing here will have a path separator at the end
 //             this function also assumes that GameWorld::arena has been initialized
 const char* GameWorld::_get_parent_dir(const char* path) {
-	mems::Arena& scratch = mems::get_scratch();
+	mems::Arena& scratch = mems::get_scratch(arena);
 	mems::ArenaScope scope(scratch);
 
 	// calculate path length, and trim whitespace from right end
@@ -73,12 +76,140 @@ const char* GameWorld::_get_parent_dir(const char* path) {
 	return returnPath;
 }
 
+// Sorts a TILE layer's tiles by cell with a counting sort, and fills in cellStart
+// it's stable, so tiles stacked in the same cell are still drawn in the order LDtk gave us
+void GameWorld::_build_tile_grid(LdtkLayerInstance& li, mems::Arena& scratch) {
+	const int nCells = li.widthCells * li.heightCells;
+	int* cellStart = static_cast<int*>(arena.push_zero_aligned(sizeof(int) * (nCells + 1), alignof(int)));
+	li.gridTile.cellStart = cellStart;
+	if (li.nData == 0 || nCells == 0) return;
+
+	mems::ArenaScope scope(scratch);
+	int* tileCell = static_cast<int*>(scratch.push_aligned(sizeof(int) * li.nData, alignof(int)));
+	for (int k = 0; k < li.nData; k++) {
+		const LdtkGridTileInstance& tile = li.gridTile.data[k];
+		const int cx = tim::clamp(tile.layerX / li.cellSize, 0, li.widthCells - 1);
+		const int cy = tim::clamp(tile.layerY / li.cellSize, 0, li.heightCells - 1);
+		tileCell[k] = cy * li.widthCells + cx;
+		cellStart[tileCell[k] + 1]++;
+	}
+
+	for (int c = 0; c < nCells; c++)
+		cellStart[c + 1] += cellStart[c];
+
+	int* cursor = static_cast<int*>(scratch.push_aligned(sizeof(int) * nCells, alignof(int)));
+	memcpy(cursor, cellStart, sizeof(int) * nCells);
+	LdtkGridTileInstance* sorted = static_cast<LdtkGridTileInstance*>(scratch.push_aligned(sizeof(LdtkGridTileInstance) * li.nData, alignof(LdtkGridTileInstance)));
+	for (int k = 0; k < li.nData; k++)
+		sorted[cursor[tileCell[k]]++] = li.gridTile.data[k];
+
+	memcpy(li.gridTile.data, sorted, sizeof(LdtkGridTileInstance) * li.nData);
+}
+
+// NOTE: the rooms are made up instead of loaded, so they can be far bigger than anything in the world file
+// every size runs the same camera path through for_each_tile_in and through a plain loop over all the tiles
+void GameWorld::bench_tiles(int maxCells, uint32_t frames, FILE* out) {
+	constexpr int CELL_SIZE = 8;
+	// the counting sort in _build_tile_grid needs about 32 bytes of scratch per tile
+	maxCells = tim::clamp(maxCells, 64, 2048);
+	frames = tim::max(frames, 1u);
+
+	GameWorld bench;
+	bench.arena.alloc(64 * 1000 * 1000, "Tile bench", mems::Arena::CHAINED);
+	LdtkTilesetDef tileset = {};
+	tileset.cellSize = CELL_SIZE;
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"frames\": %u,\n", frames);
+	fprintf(out, "\t\"camera\": [%d, %d],\n", Gfx::nesWidth, Gfx::nesHeight);
+	fprintf(out, "\t\"rooms\": [\n");
+	for (int side = 64;; side = tim::min(side * 2, maxCells)) {
+		mems::ArenaScope scope(bench.arena);
+
+		LdtkLayerInstance li = {};
+		li.type = LdtkLayerInstance::TILE;
+		li.cellSize = CELL_SIZE;
+		li.widthCells = side;
+		li.heightCells = side;
+		li.nData = side * side;
+		li.gridTile.tileset = &tileset;
+		li.gridTile.data = static_cast<LdtkGridTileInstance*>(bench.arena.push_aligned(sizeof(LdtkGridTileInstance) * li.nData, alignof(LdtkGridTileInstance)));
+
+		// a tile in every cell, shuffled like LDtk's auto layers come out, so the sort has something to do
+		uint32_t rng = 1;
+		for (int k = 0; k < li.nData; k++) {
+			LdtkGridTileInstance& tile = li.gridTile.data[k];
+			tile = {};
+			tile.layerX = (k % side) * CELL_SIZE;
+			tile.layerY = (k / side) * CELL_SIZE;
+			tile.srcX = k & 0xFF;
+		}
+		for (int k = li.nData - 1; k > 0; k--) {
+			rng = rng * 1664525u + 1013904223u;
+			const int other = static_cast<int>(rng % static_cast<uint32_t>(k + 1));
+			const LdtkGridTileInstance tile = li.gridTile.data[k];
+			li.gridTile.data[k] = li.gridTile.data[other];
+			li.gridTile.data[other] = tile;
+		}
+
+		const uint64_t buildStart = SDL_GetTicksNS();
+		bench._build_tile_grid(li, mems::get_scratch(bench.arena));
+		const uint64_t buildNs = SDL_GetTicksNS() - buildStart;
+
+		// the same camera path for both, wandering all over the room
+		const int pxSide = side * CELL_SIZE;
+		auto camera = [&](uint32_t f) {
+			return SDL_Rect{ static_cast<int>((f * 37) % static_cast<uint32_t>(pxSide - Gfx::nesWidth + 1)),
+				static_cast<int>((f * 53) % static_cast<uint32_t>(pxSide - Gfx::nesHeight + 1)), Gfx::nesWidth, Gfx::nesHeight };
+		};
+
+		uint64_t gridSum = 0, gridTiles = 0;
+		const uint64_t gridStart = SDL_GetTicksNS();
+		for (uint32_t f = 0; f < frames; f++) {
+			li.for_each_tile_in(camera(f), [&](const LdtkGridTileInstance& tile) {
+				gridSum += tile.srcX;
+				gridTiles++;
+			});
+		}
+		const uint64_t gridNs = SDL_GetTicksNS() - gridStart;
+
+		uint64_t scanSum = 0;
+		const uint64_t scanStart = SDL_GetTicksNS();
+		for (uint32_t f = 0; f < frames; f++) {
+			const SDL_Rect cam = camera(f);
+			for (int k = 0; k < li.nData; k++) {
+				const LdtkGridTileInstance& tile = li.gridTile.data[k];
+				if (tile.layerX + CELL_SIZE > cam.x && tile.layerX < cam.x + cam.w && tile.layerY + CELL_SIZE > cam.y && tile.layerY < cam.y + cam.h)
+					scanSum += tile.srcX;
+			}
+		}
+		const uint64_t scanNs = SDL_GetTicksNS() - scanStart;
+
+		const bool last = side == maxCells;
+		fprintf(out, "\t\t{ \"cells\": %d, \"tiles\": %d, \"build_ms\": %.3f, \"grid_us\": %.3f, \"scan_us\": %.3f, \"tiles_per_frame\": %.1f, \"same_tiles\": %s }%s\n",
+			side, li.nData, static_cast<double>(buildNs) / 1e6,
+			static_cast<double>(gridNs) / 1e3 / frames, static_cast<double>(scanNs) / 1e3 / frames,
+			static_cast<double>(gridTiles) / frames, gridSum == scanSum ? "true" : "false", last ? "" : ",");
+		if (last) break;
+	}
+	fprintf(out, "\t]\n");
+	fprintf(out, "}\n");
+
+	bench.arena.dealloc();
+}
+
 void GameWorld::init(const char* path) {
-	// We'll give the arena 10MB to work with
-	arena.alloc(10 * 1000 * 1000);
+	// We'll give the arena 10MB blocks to work with, bigger worlds just chain in more blocks
+	arena.alloc(10 * 1000 * 1000, "GameWorld", mems::Arena::CHAINED | mems::Arena::HUGE_PAGES);
 
 	parentDirPath = _get_parent_dir(path);
-	padded_string jsonString = padded_string::load(path);
+
+	mems::Arena& scratch = mems::get_scratch(arena);
+	mems::ArenaScope scratchScope(scratch);
+
+	mems::MappedFile jsonFile;
+	padded_string jsonFallback;
+	padded_string_view jsonString = GameContext::map_json(path, jsonFile, jsonFallback);
 	simdjson::ondemand::document doc = GET_JSON_PARSER->iterate(jsonString);
 
 	//
@@ -86,9 +217,13 @@ void GameWorld::init(const char* path) {
 	// we only care about tilesets (see https://ldtk.io/json/#ldtk-DefinitionsJson)
 	auto tilesetDefinitions = doc["defs"]["tilesets"].get_array();
 	nTilesets = static_cast<int>(tilesetDefinitions.count_elements());
-	tilesets = static_cast<LdtkTilesetDef*>(arena.push_zero(sizeof(LdtkTilesetDef) * nTilesets));
+	tilesets = static_cast<LdtkTilesetDef*>(arena.push_zero_aligned(sizeof(LdtkTilesetDef) * nTilesets, alignof(LdtkTilesetDef)));
 	int i = 0;
 
+	// every tile layer looks up its tileset by uid, this only needs to live for the duration of loading
+	tds::ArenaMap<int, LdtkTilesetDef*> tilesetsByUid;
+	tilesetsByUid.init(scratch, nTilesets);
+
 #define LOAD_STRING()
 
 	for (auto tilesetDef : tilesetDefinitions) {
@@ -103,6 +238,8 @@ void GameWorld::init(const char* path) {
 		def.cellSize = static_cast<int>(tilesetDef["tileGridSize"]);
 		def.spacing = static_cast<int>(tilesetDef["spacing"]);
 		def.padding = static_cast<int>(tilesetDef["padding"]);
+
+		tilesetsByUid.put(def.uid, &def);
 	}
 
 	//
@@ -110,7 +247,7 @@ void GameWorld::init(const char* path) {
 	//
 	auto docLevels = doc["levels"];
 	nLevels = static_cast<int>(docLevels.count_elements());
-	levels = static_cast<LdtkLevel*>(arena.push_zero(sizeof(LdtkLevel) * nLevels));
+	levels = static_cast<LdtkLevel*>(arena.push_zero_aligned(sizeof(LdtkLevel) * nLevels, alignof(LdtkLevel)));
 	i = 0;
 
 	for (auto level : docLevels) {
@@ -129,7 +266,7 @@ void GameWorld::init(const char* path) {
 		
 		auto layerInstances = level["layerInstances"].get_array();
 		l.nLayers = static_cast<int>(layerInstances.count_elements());
-		l.layers = static_cast<LdtkLayerInstance*>(arena.push(sizeof(LdtkLayerInstance) * l.nLayers));
+		l.layers = static_cast<LdtkLayerInstance*>(arena.push_aligned(sizeof(LdtkLayerInstance) * l.nLayers, alignof(LdtkLayerInstance)));
 		int j = 0;
 
 		for (auto layerInst : layerInstances) {
@@ -157,19 +294,14 @@ void GameWorld::init(const char* path) {
 			switch (li.type) {
 			case LdtkLayerInstance::TILE: {
 				// set tileset
-				li.gridTile.tileset = nullptr;
 				int tilesetUid = static_cast<int>(layerInst["__tilesetDefUid"]);
-				for (int a = 0; a < nTilesets; a++) {
-					if (tilesetUid == tilesets[a].uid) {
-						li.gridTile.tileset = &tilesets[a];
-						break;
-					}
-				}
+				LdtkTilesetDef** tileset = tilesetsByUid.find(tilesetUid);
+				li.gridTile.tileset = tileset ? *tileset : nullptr;
 
 				// load gridTiles
 				auto gridTilesArray = layerInst["gridTiles"].get_array();
 				li.nData = static_cast<int>(gridTilesArray.count_elements());
-				li.gridTile.data = static_cast<LdtkGridTileInstance*>(arena.push(sizeof(LdtkGridTileInstance) * li.nData));
+				li.gridTile.data = static_cast<LdtkGridTileInstance*>(arena.push_aligned(sizeof(LdtkGridTileInstance) * li.nData, alignof(LdtkGridTileInstance)));
 				int k = 0;
 				for (auto tile : gridTilesArray) {
 					LdtkGridTileInstance& gti = li.gridTile.data[k++];
@@ -181,11 +313,13 @@ void GameWorld::init(const char* path) {
 					gti.id = static_cast<int>(tile["t"]);
 					gti.alpha = static_cast<float>(tile["a"]);
 				}
+
+				_build_tile_grid(li, scratch);
 			} break;
 			case LdtkLayerInstance::INTGRID: {
 				auto intGridArray = layerInst["intGridCsv"].get_array();
 				li.nData = static_cast<int>(intGridArray.count_elements());
-				li.intGridData = static_cast<int*>(arena.push(sizeof(int) * li.nData));
+				li.intGridData = static_cast<int*>(arena.push_aligned(sizeof(int) * li.nData, alignof(int)));
 				int k = 0;
 				for (auto element : intGridArray) {
 					li.intGridData[k++] = static_cast<int>(element);
@@ -200,6 +334,9 @@ void GameWorld::init(const char* path) {
 		if (-1 == l.collisionLayerIdx)
 			fprintf(stderr, "Failed to find collision layer while loading %s", path);
 	}
+
+	// everything we need from the document has been copied into the world arena by now
+	mems::unmap_file(jsonFile);
 }
 
 void GameWorld::cleanup() {
@@ -221,54 +358,191 @@ void GameWorld::load_assets(TextureAtlas& atlas) {
 
 		set.atlasIdx = atlas.add_to_atlas(nullptr, tilesetPath);
 	}
+
+	// reserve a sprite for every chunk that has any tiles in it, bake_tiles fills them in once the atlas is packed
+	for (int i = 0; i < nLevels; i++) {
+		mems::ArenaScope forScope(scratch);
+
+		LdtkLevel& level = levels[i];
+		const int chunksX = (level.pxWidth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		const int chunksY = (level.pxHeight + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		bool* used = static_cast<bool*>(scratch.push_zero(sizeof(bool) * chunksX * chunksY));
+
+		for (int j = 0; j < level.nLayers; j++) {
+			const LdtkLayerInstance& li = level.layers[j];
+			if (li.type != LdtkLayerInstance::TILE || !li.gridTile.tileset) continue;
+
+			const int tileSize = li.gridTile.tileset->cellSize;
+			for (int k = 0; k < li.nData; k++) {
+				const LdtkGridTileInstance& tile = li.gridTile.data[k];
+
+				// tiles don't have to line up with the chunks, so mark every chunk the tile touches
+				const int cx0 = tim::clamp(tile.layerX / CHUNK_SIZE, 0, chunksX - 1);
+				const int cy0 = tim::clamp(tile.layerY / CHUNK_SIZE, 0, chunksY - 1);
+				const int cx1 = tim::clamp((tile.layerX + tileSize - 1) / CHUNK_SIZE, 0, chunksX - 1);
+				const int cy1 = tim::clamp((tile.layerY + tileSize - 1) / CHUNK_SIZE, 0, chunksY - 1);
+				for (int cy = cy0; cy <= cy1; cy++)
+					for (int cx = cx0; cx <= cx1; cx++)
+						used[cy * chunksX + cx] = true;
+			}
+		}
+
+		level.nChunks = 0;
+		for (int c = 0; c < chunksX * chunksY; c++) {
+			if (used[c]) level.nChunks++;
+		}
+		level.chunks = static_cast<LdtkTileChunk*>(arena.push_aligned(sizeof(LdtkTileChunk) * level.nChunks, alignof(LdtkTileChunk)));
+
+		int n = 0;
+		for (int c = 0; c < chunksX * chunksY; c++) {
+			if (!used[c]) continue;
+
+			LdtkTileChunk& chunk = level.chunks[n++];
+			chunk.pxX = (c % chunksX) * CHUNK_SIZE;
+			chunk.pxY = (c / chunksX) * CHUNK_SIZE;
+			chunk.width = tim::min(CHUNK_SIZE, level.pxWidth - chunk.pxX);
+			chunk.height = tim::min(CHUNK_SIZE, level.pxHeight - chunk.pxY);
+
+			char key[SubTexture::KEY_LENGTH];
+			snprintf(key, SubTexture::KEY_LENGTH, "%s_%d_%d", level.identifier, c % chunksX, c / chunksX);
+			chunk.atlasIdx = atlas.reserve_sprite(key, chunk.width, chunk.height);
+		}
+	}
 }
 
-void GameWorld::render(Gfx& gfx, const GameContext& ctx) {
-	const SDL_FRect cameraRect = gfx.cam_bboxf();
+// straight alpha "over", alpha is the layer opacity times the tile alpha
+static void blend_texel(uint8_t* dst, const uint8_t* src, float alpha) {
+	const float sa = (src[3] / 255.0f) * alpha;
+	if (sa <= 0.0f) return;
 
+	const float da = dst[3] / 255.0f;
+	const float outA = sa + da * (1.0f - sa);
+	for (int c = 0; c < 3; c++)
+		dst[c] = static_cast<uint8_t>((src[c] * sa + dst[c] * da * (1.0f - sa)) / outA + 0.5f);
+	dst[3] = static_cast<uint8_t>(outA * 255.0f + 0.5f);
+}
 
-	for (int i = 0; i < ctx.nProcessRooms; i++) {
-		const LdtkLevel& level = *ctx.processRooms[i];
-		const SDL_FRect levelRect = level.get_bboxf();
+void GameWorld::bake_tiles(TextureAtlas& atlas) {
+	assert(atlas.isPacked);
+	const int stride = atlas.width * TextureAtlas::NUM_CHANNELS;
 
-		// skip rendering level if it is not visible
-		if (!SDL_HasRectIntersectionFloat(&cameraRect, &levelRect)) continue;
+	for (int i = 0; i < nLevels; i++) {
+		LdtkLevel& level = levels[i];
 
-		for (int j = 0; j < level.nLayers; j++) {
-			LdtkLayerInstance& li = level.layers[j];
-			if (li.type == LdtkLayerInstance::TILE) {
-				const uint32_t atlasIdx = li.gridTile.tileset->atlasIdx;
+		for (int c = 0; c < level.nChunks; c++) {
+			LdtkTileChunk& chunk = level.chunks[c];
+			if (chunk.atlasIdx == TextureAtlas::INVALID_IDX) continue;
+
+			const SubTexture& dstTex = atlas.subTextures[chunk.atlasIdx];
+			if (dstTex.x < 0) {
+				fprintf(stderr, "No room in the atlas to bake %s, drawing its tiles one by one instead\n", dstTex.key);
+				chunk.atlasIdx = TextureAtlas::INVALID_IDX;
+				continue;
+			}
+
+			// a cooked atlas was saved after baking, its pixels already have the tiles in them
+			if (atlas.isCooked) continue;
+
+			// LDtk sorts layerInstances with the top-most layer first, so composite them back to front
+			for (int j = level.nLayers - 1; j >= 0; j--) {
+				const LdtkLayerInstance& li = level.layers[j];
+				if (li.type != LdtkLayerInstance::TILE || !li.gridTile.tileset) continue;
+				if (li.gridTile.tileset->atlasIdx == TextureAtlas::INVALID_IDX) continue;
+
+				const SubTexture& setTex = atlas.subTextures[li.gridTile.tileset->atlasIdx];
 				const int tileSize = li.gridTile.tileset->cellSize;
 
-				for (int k = 0; k < li.nData; k++) {
-					const LdtkGridTileInstance& tile = li.gridTile.data[k];
-					gfx.queue_sprite(tile.layerX, tile.layerY, atlasIdx, { tile.srcX, tile.srcY, tileSize, tileSize }, true);
-				}
+				// the tileset and the chunk don't have to be on the same page
+				const uint8_t* setPixels = static_cast<const uint8_t*>(atlas.page_data(setTex.page));
+				uint8_t* chunkPixels = static_cast<uint8_t*>(atlas.page_data(dstTex.page));
+
+				const SDL_Rect chunkRect = { chunk.pxX, chunk.pxY, chunk.width, chunk.height };
+				li.for_each_tile_in(chunkRect, [&](const LdtkGridTileInstance& tile) {
+					// part of the tile that lands in this chunk, in level space
+					const int x0 = tim::max(tile.layerX, chunk.pxX);
+					const int y0 = tim::max(tile.layerY, chunk.pxY);
+					const int x1 = tim::min(tile.layerX + tileSize, chunk.pxX + chunk.width);
+					const int y1 = tim::min(tile.layerY + tileSize, chunk.pxY + chunk.height);
+					if (x0 >= x1 || y0 >= y1) return;
+
+					// LDtk flip bits: 1 is horizontal, 2 is vertical
+					const bool flipX = tile.flip & 1;
+					const bool flipY = tile.flip & 2;
+					const float alpha = li.opacity * tile.alpha;
+
+					for (int y = y0; y < y1; y++) {
+						const int ty = flipY ? tileSize - 1 - (y - tile.layerY) : y - tile.layerY;
+						const uint8_t* srcRow = setPixels + (setTex.y + tile.srcY + ty) * stride;
+						uint8_t* dstRow = chunkPixels + (dstTex.y + y - chunk.pxY) * stride;
+
+						for (int x = x0; x < x1; x++) {
+							const int tx = flipX ? tileSize - 1 - (x - tile.layerX) : x - tile.layerX;
+							blend_texel(
+								dstRow + (dstTex.x + x - chunk.pxX) * TextureAtlas::NUM_CHANNELS,
+								srcRow + (setTex.x + tile.srcX + tx) * TextureAtlas::NUM_CHANNELS,
+								alpha);
+						}
+					}
+				});
 			}
 		}
 	}
+}
 
+// fallback for chunks that couldn't be baked, draws the tiles overlapping levelRegion one by one
+void GameWorld::_queue_tiles(Gfx& gfx, const LdtkLevel& level, const SDL_Rect& levelRegion) const {
+	for (int j = level.nLayers - 1; j >= 0; j--) {
+		const LdtkLayerInstance& li = level.layers[j];
+		if (li.type != LdtkLayerInstance::TILE || !li.gridTile.tileset) continue;
+
+		const uint32_t atlasIdx = li.gridTile.tileset->atlasIdx;
+		const int tileSize = li.gridTile.tileset->cellSize;
+
+		// only visits the cells overlapping levelRegion, which is at most a screen's worth
+		li.for_each_tile_in(levelRegion, [&](const LdtkGridTileInstance& tile) {
+			const SDL_FColor color = { 1.0f, 1.0f, 1.0f, li.opacity * tile.alpha };
+			gfx.queue_sprite(level.pxWorldX + tile.layerX, level.pxWorldY + tile.layerY, atlasIdx,
+				{ tile.srcX, tile.srcY, tileSize, tileSize }, true, color, tile.flip & 1, tile.flip & 2);
+		});
+	}
+}
 
-	/*
-	for (int i = 0; i < nLevels; i++) {
-		LdtkLevel& level = levels[i];
+void GameWorld::render(Gfx& gfx, const GameContext& ctx) {
+	const SDL_FRect cameraRect = gfx.cam_bboxf();
+
+	for (int i = 0; i < ctx.nProcessRooms; i++) {
+		const LdtkLevel& level = *ctx.processRooms[i];
 		const SDL_FRect levelRect = level.get_bboxf();
 
 		// skip rendering level if it is not visible
 		if (!SDL_HasRectIntersectionFloat(&cameraRect, &levelRect)) continue;
 
-		for (int j = 0; j < level.nLayers; j++) {
-			LdtkLayerInstance& li = level.layers[j];
-			if (li.type == LdtkLayerInstance::TILE) {
-				const uint32_t atlasIdx = li.gridTile.tileset->atlasIdx;
-				const int tileSize = li.gridTile.tileset->cellSize;
-
-				for (int k = 0; k < li.nData; k++) {
-					const LdtkGridTileInstance& tile = li.gridTile.data[k];
-					gfx.queue_sprite(tile.layerX, tile.layerY, atlasIdx, {tile.srcX, tile.srcY, tileSize, tileSize}, true);
-				}
+		// static tiles are baked into chunks, so this is one quad per visible chunk no matter how many tiles there are
+		for (int c = 0; c < level.nChunks; c++) {
+			const LdtkTileChunk& chunk = level.chunks[c];
+			const SDL_FRect chunkRect = {
+				static_cast<float>(level.pxWorldX + chunk.pxX),
+				static_cast<float>(level.pxWorldY + chunk.pxY),
+				static_cast<float>(chunk.width),
+				static_cast<float>(chunk.height)
+			};
+
+			SDL_FRect visible;
+			if (!SDL_GetRectIntersectionFloat(&cameraRect, &chunkRect, &visible)) continue;
+
+			// crop to the camera, rounded out to whole pixels since the camera can sit between them
+			const int x0 = static_cast<int>(floorf(visible.x - chunkRect.x));
+			const int y0 = static_cast<int>(floorf(visible.y - chunkRect.y));
+			const int x1 = tim::min(static_cast<int>(ceilf(visible.x + visible.w - chunkRect.x)), chunk.width);
+			const int y1 = tim::min(static_cast<int>(ceilf(visible.y + visible.h - chunkRect.y)), chunk.height);
+			const SDL_Rect src = { x0, y0, x1 - x0, y1 - y0 };
+
+			if (chunk.atlasIdx == TextureAtlas::INVALID_IDX) {
+				_queue_tiles(gfx, level, SDL_Rect{ chunk.pxX + x0, chunk.pxY + y0, src.w, src.h });
+				continue;
 			}
+
+			gfx.queue_sprite(level.pxWorldX + chunk.pxX + x0, level.pxWorldY + chunk.pxY + y0, chunk.atlasIdx, src, true);
 		}
 	}
-	*/
 }
\ No newline at end of file
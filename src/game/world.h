@@ -1,7 +1,9 @@
 #pragma once
 
 #include <SDL3/SDL_rect.h>
+#include <stdio.h>
 #include <mems.hpp>
+#include <tinydef.hpp>
 
 // Based on https://ldtk.io/json/#ldtk-DefinitionsJson
 // It's implied that because of the redundant data stored for each entity, layer, and intgrid instance prefixed with "__"
@@ -92,13 +94,50 @@ struct LdtkLayerInstance {
 			// we use the tileset uid to find this
 			LdtkTilesetDef* tileset;
 
-			// loaded from gridTiles
+			// loaded from gridTiles, sorted by the cell they're in (tiles stacked in one cell keep their order)
 			LdtkGridTileInstance* data;
+
+			// data[cellStart[c]] up to data[cellStart[c + 1]] are the tiles in cell c = y * widthCells + x,
+			// so looking up an area only has to visit the cells that overlap it
+			int* cellStart;
 		} gridTile;
 
 		// loaded from entityInstances
 		LdtkEntityInstance* entityData;
 	};
+
+	// calls f(const LdtkGridTileInstance&) for every tile of a TILE layer that can overlap region (in level pixels)
+	// the cost scales with the area of region, not with how many tiles the layer has
+	template<typename F>
+	void for_each_tile_in(const SDL_Rect& region, F&& f) const {
+		if (type != TILE || nData == 0 || region.w <= 0 || region.h <= 0) return;
+
+		// tiles are bucketed by their top left corner, so a tile bigger than a cell can stick into the region
+		// from a cell up or to the left of it
+		const int tileSize = gridTile.tileset ? gridTile.tileset->cellSize : cellSize;
+		const int reach = tim::max(tileSize - cellSize, 0);
+
+		const int cx0 = tim::max(region.x - reach, 0) / cellSize;
+		const int cy0 = tim::max(region.y - reach, 0) / cellSize;
+		const int cx1 = tim::min((region.x + region.w - 1) / cellSize, widthCells - 1);
+		const int cy1 = tim::min((region.y + region.h - 1) / cellSize, heightCells - 1);
+		if (cx0 > cx1 || cy0 > cy1) return;
+
+		for (int cy = cy0; cy <= cy1; cy++) {
+			// a row of cells is contiguous in data
+			const int first = gridTile.cellStart[cy * widthCells + cx0];
+			const int last = gridTile.cellStart[cy * widthCells + cx1 + 1];
+			for (int k = first; k < last; k++) f(gridTile.data[k]);
+		}
+	}
+};
+
+// A piece of a level's static tile layers, baked into a single atlas sprite by GameWorld::bake_tiles
+// so drawing a room is a handful of quads instead of one per tile
+struct LdtkTileChunk {
+	int pxX, pxY;    // relative to the level
+	int width, height;
+	uint32_t atlasIdx;    // TextureAtlas::INVALID_IDX if it couldn't be baked, then the tiles get drawn one by one
 };
 
 struct LdtkLevel {
@@ -115,6 +154,10 @@ struct LdtkLevel {
 
 	int collisionLayerIdx;
 
+	// only chunks that actually have tiles in them are kept
+	int nChunks;
+	LdtkTileChunk* chunks;
+
 	SDL_Rect get_bbox() const;
 	SDL_FRect get_bboxf() const;
 };
@@ -135,10 +178,22 @@ struct GameWorld {
 	// call this after init, before packing atlas
 	void load_assets(struct TextureAtlas& atlas);
 
+	// call this after packing the atlas, before uploading it
+	// composites every chunk of static tiles into the space load_assets reserved in the atlas
+	// (unless the atlas is cooked, then it only falls back on drawing tiles for chunks that didn't fit)
+	static constexpr int CHUNK_SIZE = 128;
+	void bake_tiles(struct TextureAtlas& atlas);
+
+	// builds made up rooms of 64x64 cells doubling up to maxCells x maxCells (8px cells, up to 2048), then times
+	// for_each_tile_in against a loop over every tile for a camera sized region, and prints it as json (see --bench-tiles)
+	static void bench_tiles(int maxCells, uint32_t frames, FILE* out);
+
 	bool shouldDrawTiles = true;
 	bool shouldDrawInt = true;
 	void render(struct Gfx& gfx, const struct GameContext& ctx);
 private:
 	const char* _get_parent_dir(const char* path);
+	void _build_tile_grid(LdtkLayerInstance& li, mems::Arena& scratch);
+	void _queue_tiles(struct Gfx& gfx, const LdtkLevel& level, const SDL_Rect& levelRegion) const;
 	mems::Arena arena;
 };
\ No newline at end of file
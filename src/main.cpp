@@ -5,6 +5,9 @@
 #include "engine/game_context.h"
 #include "engine/image_asset.h"
 #include "engine/audio.h"
+#include "engine/frame_pacer.h"
+#include "engine/profiler.h"
+#include "engine/frame_capture.h"
 
 #include "game/player.h"
 #include "game/enemy.h"
@@ -12,10 +15,11 @@
 #include "game.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <tinydef.hpp>
 #include <mems.hpp>
-#include <vector>
 
 constexpr int defWidth = Gfx::nesWidth * 4, defHeight = Gfx::nesHeight * 4;
 int windowWidth = defWidth, windowHeight = defHeight;    // these are here if we ever want it for some reason
@@ -24,25 +28,165 @@ Input input;
 Gfx gfx;
 TextureAtlas atlas;
 GameWorld world;
+FrameCapture frameCapture;
 
+mems::Arena entityArena;
+mems::Arena frameArenas[2];    // see GameContext::frameArena
 Player player;
-std::vector<Enemy> enemies;
+tds::Pool<Enemy> enemies;
+tds::Pool<Projectile> playerProjectiles;
+tds::Pool<Projectile> enemyProjectiles;
 
 bool paused = false;
 bool inMainMenu = true;
 
 GameContext game = {
-	.delta = 1.0f / 60.0f,
+	.delta = GameContext::TICK_SEC,
 	.points = 0,
+	.alpha = 1.0f,
 	.targetFps = 60,
 	.gfx = &gfx,
 	.input = &input,
 	.atlas = &atlas,
 	.world = &world,
 	.player = &player,
+	.enemies = &enemies,
+	.playerProjectiles = &playerProjectiles,
+	.enemyProjectiles = &enemyProjectiles,
 };
 
+// flips the frame arenas, last frame's allocations stay readable through prevFrameArena
+static void next_frame_arena() {
+	mems::Arena* lastFrame = game.frameArena;
+	game.frameArena = game.prevFrameArena;
+	game.prevFrameArena = lastFrame;
+	game.frameArena->clear();
+}
+
+// every commit and decommit any arena has made so far, see mems::Arena::nCommits
+static uint64_t count_arena_commits() {
+	mems::ArenaStats stats[mems::MAX_TRACKED];
+	const int n = mems::get_arena_stats(stats, mems::MAX_TRACKED);
+	uint64_t total = 0;
+	for (int i = 0; i < n; i++) total += stats[i].nCommits;
+	return total;
+}
+
+// runs nFrames updates (and renders) as fast as possible and prints how long they took as json
+// NOTE: this is what catches performance regressions on machines without a display, keep the json keys stable
+static void run_benchmark(uint32_t nFrames, bool render, Gfx::Backend backend, FILE* out) {
+	tds::ArenaArray<uint64_t> frameNs;
+	frameNs.init(nFrames * 2, "Benchmark frame times");    // the second half is scratch for the sort
+
+	// NOTE: once both frame arenas have been through a frame, pushing should never have to reach the OS again
+	// "arena_commits" splits the commits into those two warmup frames and the rest, the steady state ones should stay 0
+	constexpr uint32_t WARMUP_FRAMES = 2;
+	const uint64_t startCommits = count_arena_commits();
+	uint64_t warmupCommits = 0;
+
+	// the render command sort on its own, since it's the only part of rendering that grows faster than the command count
+	uint64_t sortNs = 0, maxSortNs = 0, sortedCmds = 0;
+
+	game.alpha = 1.0f;
+	const uint64_t start = SDL_GetTicksNS();
+	for (uint32_t i = 0; i < nFrames; i++) {
+		const uint64_t frameStart = SDL_GetTicksNS();
+		next_frame_arena();
+		profiler.begin_frame();
+
+		game_update();
+		input.end_frame();
+
+		if (render) {
+			gfx.begin_frame();
+			game_render();
+			gfx.layer = Gfx::LAYER_HUD;
+			gfx.queue_counter(5, 5, "PTS ", game.points);
+			gfx.finish_frame();
+			sortNs += gfx.lastFrameStats.sortNs;
+			maxSortNs = tim::max(maxSortNs, gfx.lastFrameStats.sortNs);
+			sortedCmds += gfx.lastFrameStats.commands;
+		}
+
+		profiler.end_frame();
+		frameNs.push(SDL_GetTicksNS() - frameStart);
+		if (i + 1 == WARMUP_FRAMES) warmupCommits = count_arena_commits() - startCommits;
+	}
+	const uint64_t totalNs = SDL_GetTicksNS() - start;
+	const uint64_t totalCommits = count_arena_commits() - startCommits;
+	if (nFrames < WARMUP_FRAMES) warmupCommits = totalCommits;
+	const uint64_t steadyCommits = totalCommits - warmupCommits;
+
+	for (uint32_t i = 0; i < nFrames; i++) frameNs.push(0);
+	const uint64_t* sorted = tds::radix_sort(frameNs.data, frameNs.data + nFrames, nFrames);
+
+	// nearest rank
+	auto percentile_ms = [&](uint32_t p) {
+		const uint32_t rank = tim::max((p * nFrames + 99) / 100, 1u);
+		return static_cast<double>(sorted[rank - 1]) / 1e6;
+	};
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"frames\": %u,\n", nFrames);
+	fprintf(out, "\t\"render\": %s,\n", render ? "true" : "false");
+	fprintf(out, "\t\"backend\": \"%s\",\n", backend == Gfx::SOFTWARE ? "software" : "hardware");
+	fprintf(out, "\t\"kernels\": \"%s\",\n", gfx.kernels);
+	fprintf(out, "\t\"total_ms\": %.3f,\n", static_cast<double>(totalNs) / 1e6);
+	fprintf(out, "\t\"fps\": %.1f,\n", totalNs ? static_cast<double>(nFrames) * 1e9 / static_cast<double>(totalNs) : 0.0);
+	fprintf(out, "\t\"arena_commits\": { \"warmup\": %llu, \"steady\": %llu },\n",
+		static_cast<unsigned long long>(warmupCommits), static_cast<unsigned long long>(steadyCommits));
+	if (render) {
+		fprintf(out, "\t\"cmd_sort\": { \"mean_us\": %.3f, \"max_us\": %.3f, \"mean_cmds\": %.1f, \"ns_per_cmd\": %.2f },\n",
+			static_cast<double>(sortNs) / 1e3 / nFrames, static_cast<double>(maxSortNs) / 1e3,
+			static_cast<double>(sortedCmds) / nFrames, sortedCmds ? static_cast<double>(sortNs) / static_cast<double>(sortedCmds) : 0.0);
+	}
+	fprintf(out, "\t\"frame_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }\n",
+		static_cast<double>(totalNs) / 1e6 / nFrames, percentile_ms(50), percentile_ms(95), percentile_ms(99),
+		static_cast<double>(sorted[nFrames - 1]) / 1e6);
+	fprintf(out, "}\n");
+
+	frameNs.release();
+}
+
 int main(int argc, char** argv) {
+	// --software rasterizes on the cpu, for machines without a gpu
+	// --replay <file> draws a frame dumped with F12 over and over instead of running the game
+	// --bench <frames> runs the game headless with no frame cap and prints frame time stats as json, see run_benchmark
+	//     --bench-render also renders every frame (offscreen), --bench-out <file> writes the json there instead of stdout
+	// --bench-tiles <cells> times tile lookups in made up rooms of up to cells x cells as json, then quits (also --bench-out)
+	// --bench-load <runs> times loading the world and packing the atlas with and without huge pages as json, then quits (also --bench-out)
+	//     --bench-threads <n> decodes the atlas images on n threads instead of one per core
+	// --profile-csv <file> writes the profiler's last Profiler::HISTORY frames there on exit (F3 shows them in game)
+	// --record <path> records every frame, to a y4m video if path ends in .y4m, otherwise to <path>_000000.png stills (F11 toggles a y4m in game)
+	Gfx::Backend gfxBackend = Gfx::HARDWARE;
+	const char* replayPath = nullptr;
+	uint32_t benchFrames = 0;
+	uint32_t benchLoadRuns = 0;
+	int benchThreads = 0;
+	int benchTileCells = 0;
+	bool benchRender = false;
+	const char* benchOutPath = nullptr;
+	const char* profileCsvPath = nullptr;
+	const char* recordPath = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--software") == 0) gfxBackend = Gfx::SOFTWARE;
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPath = argv[++i];
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) benchFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		else if (strcmp(argv[i], "--bench-load") == 0 && i + 1 < argc) benchLoadRuns = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		else if (strcmp(argv[i], "--bench-tiles") == 0 && i + 1 < argc) benchTileCells = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bench-threads") == 0 && i + 1 < argc) benchThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bench-render") == 0) benchRender = true;
+		else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) benchOutPath = argv[++i];
+		else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) profileCsvPath = argv[++i];
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+	}
+
+	// no display or sound card needed for benchmarks
+	if (benchFrames || benchLoadRuns || benchTileCells) {
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+		SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+	}
+
 	//
 	// INIT
 	//
@@ -52,57 +196,153 @@ int main(int argc, char** argv) {
 	mems::init();
 	GameContext::init();
 
+	// these load everything on their own, so they don't need a window or the game
+	if (benchLoadRuns || benchTileCells) {
+		FILE* out = benchOutPath ? fopen(benchOutPath, "w") : stdout;
+		if (!out) {
+			fprintf(stderr, "Could not open %s for the benchmark results\n", benchOutPath);
+			return -1;
+		}
+		if (benchLoadRuns) game_bench_load(benchLoadRuns, benchThreads, out);
+		else GameWorld::bench_tiles(benchTileCells, 100, out);
+		if (out != stdout) fclose(out);
+
+		GameContext::cleanup();
+		mems::close();
+		SDL_Quit();
+		return 0;
+	}
+
+	// these only reserve address space, frames will rarely commit more than a few pages
+	frameArenas[0].alloc(64 * 1000 * 1000, "frame0");
+	frameArenas[1].alloc(64 * 1000 * 1000, "frame1");
+	game.frameArena = &frameArenas[0];
+	game.prevFrameArena = &frameArenas[1];
+
 	// create window and init graphics
 	game.window = SDL_CreateWindow("Mage Game", windowWidth, windowHeight, SDL_WINDOW_HIDDEN | SDL_WINDOW_RESIZABLE);
 	SDL_SetWindowMinimumSize(game.window, Gfx::nesWidth, Gfx::nesHeight);
-	if (!gfx.init(game.window))
+	if (!gfx.init(game.window, gfxBackend))
 		return -1;
 
 	game_init();
 	audio_init();
 
-	SDL_ShowWindow(game.window);
+	// the replayed frame needs the same atlas, so this has to happen after game_init
+	mems::Arena replayArena = {};
+	RenderCmdStream replayFrame = {};
+	if (replayPath) {
+		replayArena.alloc(mems::Arena::DEFAULT_CAPACITY, "Replay");
+		if (!Gfx::load_frame(replayPath, replayArena, replayFrame))
+			return -1;
+	}
+	bool dumpFrame = false;
+
+	// draw as many frames as the display shows, updates stay at GameContext::TICK_RATE either way
+	const SDL_DisplayMode* displayMode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(game.window));
+	if (displayMode && displayMode->refresh_rate > 0.0f)
+		game.targetFps = static_cast<uint64_t>(displayMode->refresh_rate + 0.5f);
+
+	gfx.capture = &frameCapture;
+	if (recordPath) {
+		const size_t len = strlen(recordPath);
+		const FrameCapture::Format format = len > 4 && strcmp(recordPath + len - 4, ".y4m") == 0 ? FrameCapture::Y4M : FrameCapture::PNG;
+		frameCapture.start(recordPath, format, Gfx::nesWidth, Gfx::nesHeight, static_cast<int>(game.targetFps));
+	}
+
+	if (benchFrames) {
+		FILE* out = benchOutPath ? fopen(benchOutPath, "w") : stdout;
+		if (!out) {
+			fprintf(stderr, "Could not open %s for the benchmark results\n", benchOutPath);
+			return -1;
+		}
+
+		run_benchmark(benchFrames, benchRender, gfxBackend, out);
+		if (out != stdout) fclose(out);
+	} else {
+		SDL_ShowWindow(game.window);
+	}
+
+	FramePacer pacer;
+	pacer.init(game.target_ns());
 
 	//
 	// MAIN LOOP
 	//
 	float mainMenuTimer{};
 
-	while (true) {
-		// timer start - this is meant for framelimiting
-		Uint64 startFrame = SDL_GetTicksNS();
+	// after a hitch, only this many updates worth of time get caught up on,
+	// otherwise a slow frame makes the next one run even more updates and it never recovers
+	constexpr uint64_t MAX_CATCHUP_TICKS = 5;
+	uint64_t accumulator = 0;
+	Uint64 lastFrameStart = SDL_GetTicksNS();
+
+	// a benchmark run already did all its frames, so it goes straight to cleanup
+	bool quit = false;
+	while (benchFrames == 0 && !quit) {
+		const Uint64 frameStart = SDL_GetTicksNS();
+		const Uint64 frameNs = frameStart - lastFrameStart;
+		lastFrameStart = frameStart;
+
+		next_frame_arena();
+		profiler.begin_frame();
 
 		// process events
-		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
-			switch (event.type) {
-			case SDL_EVENT_WINDOW_RESIZED:
-				windowWidth = event.window.data1;
-				windowHeight = event.window.data2;
-				[[fallthrough]];
-			case SDL_EVENT_WINDOW_MOVED:
-				game.delta = game.target_sec();
-				startFrame = SDL_GetTicksNS();
-				break;
-
-			case SDL_EVENT_QUIT:
-				return EXIT_SUCCESS;
-
-			case SDL_EVENT_KEY_DOWN:
-			case SDL_EVENT_KEY_UP:
-			case SDL_EVENT_MOUSE_BUTTON_DOWN:
-			case SDL_EVENT_MOUSE_BUTTON_UP:
-			case SDL_EVENT_MOUSE_MOTION:
-			case SDL_EVENT_GAMEPAD_AXIS_MOTION:
-			case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
-			case SDL_EVENT_GAMEPAD_BUTTON_UP:
-				input.handle_event(event);
-				break;
+		{
+			PROFILE_ZONE("events");
+			SDL_Event event;
+			while (SDL_PollEvent(&event)) {
+				switch (event.type) {
+				case SDL_EVENT_WINDOW_RESIZED:
+					windowWidth = event.window.data1;
+					windowHeight = event.window.data2;
+					[[fallthrough]];
+				case SDL_EVENT_WINDOW_MOVED:
+					// the loop was stuck while the window was being dragged, don't try to simulate all that time
+					accumulator = 0;
+					lastFrameStart = SDL_GetTicksNS();
+					break;
+
+				case SDL_EVENT_QUIT:
+					quit = true;
+					break;
+
+				case SDL_EVENT_KEY_DOWN:
+					// dump this frame's render commands, see --replay
+					if (event.key.scancode == SDL_SCANCODE_F12) dumpFrame = true;
+					// and the profiler overlay
+					if (event.key.scancode == SDL_SCANCODE_F3) profiler.showOverlay = !profiler.showOverlay;
+					// and recording
+					if (event.key.scancode == SDL_SCANCODE_F11 && !event.key.repeat) {
+						if (frameCapture.is_recording()) {
+							frameCapture.stop();
+						} else {
+							const char* path = mems::push_printf(*game.frameArena, "capture_%llu.y4m", static_cast<unsigned long long>(SDL_GetTicks()));
+							frameCapture.start(path, FrameCapture::Y4M, Gfx::nesWidth, Gfx::nesHeight, static_cast<int>(game.targetFps));
+						}
+					}
+					[[fallthrough]];
+				case SDL_EVENT_KEY_UP:
+				case SDL_EVENT_MOUSE_BUTTON_DOWN:
+				case SDL_EVENT_MOUSE_BUTTON_UP:
+				case SDL_EVENT_MOUSE_MOTION:
+				case SDL_EVENT_GAMEPAD_AXIS_MOTION:
+				case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
+				case SDL_EVENT_GAMEPAD_BUTTON_UP:
+					input.handle_event(event);
+					break;
+				}
 			}
 		}
 
-		if (inMainMenu) {
-			mainMenuTimer += game.delta;
+		if (replayPath) {
+			gfx.begin_frame();
+			gfx.queue_frame(replayFrame);
+			gfx.finish_frame();
+		}
+
+		else if (inMainMenu) {
+			mainMenuTimer += SDL_NS_TO_SECONDS(static_cast<float>(frameNs));
 
 			if (input.start.clicked()) {
 				input.start.down = false; // Prevents pausing the game immediately
@@ -112,7 +352,7 @@ int main(int argc, char** argv) {
 			}
 
 			gfx.begin_frame();
-
+			gfx.layer = Gfx::LAYER_HUD;
 
 			gfx.queue_text(Gfx::nesWidth / 2.8, Gfx::nesHeight / 8, "Mage Game!");
 
@@ -125,15 +365,24 @@ int main(int argc, char** argv) {
 		}
 
 		else {
-			if (input.start.clicked())
-				paused = !paused;
-
 			//
 			// update
 			//
-			if (!paused) game_update();
+			// fixed steps for however much time has passed, whatever is left over carries into the next frame
+			accumulator += tim::min(frameNs, MAX_CATCHUP_TICKS * GameContext::TICK_NS);
+			while (accumulator >= GameContext::TICK_NS) {
+				if (input.start.clicked())
+					paused = !paused;
+
+				if (!paused) game_update();
 
-			input.end_frame();
+				// NOTE: only after an update actually ran, so a press isn't lost on frames that don't update
+				input.end_frame();
+				accumulator -= GameContext::TICK_NS;
+			}
+
+			// nothing moves while paused, so draw exactly where things are
+			game.alpha = paused ? 1.0f : static_cast<float>(accumulator) / static_cast<float>(GameContext::TICK_NS);
 			audio_tick();
 
 			//
@@ -143,9 +392,8 @@ int main(int argc, char** argv) {
 
 			game_render();
 
-			static char pointStr[32];
-			snprintf(pointStr, 32, "PTS %d", game.points);
-			gfx.queue_text(5, 5, pointStr);
+			gfx.layer = Gfx::LAYER_HUD;
+			gfx.queue_counter(5, 5, "PTS ", game.points);
 
 			if (paused) {
 				constexpr int PAUSED_TEXT_X = (Gfx::nesWidth / 2) - (static_cast<int>(std::char_traits<char>::length("PAUSED") * 8) / 2);
@@ -153,28 +401,36 @@ int main(int argc, char** argv) {
 				gfx.queue_text(PAUSED_TEXT_X, PAUSED_TEXT_Y, "PAUSED");
 			}
 
+			if (profiler.showOverlay) profiler.draw_overlay(gfx);
+
 			gfx.finish_frame();
 		}
 
-		// end frame - framelimiting logic
-		Uint64 elapsed = SDL_GetTicksNS() - startFrame;
-		if (game.target_ns() > elapsed) {
-			// keep in mind these values are unsigned, we do not want to have an underflow to UINT64_MAX
-			SDL_DelayNS(game.target_ns() - elapsed);
+		if (dumpFrame) {
+			gfx.dump_frame(mems::push_printf(*game.frameArena, "frame_%llu.gfxcmd", static_cast<unsigned long long>(SDL_GetTicks())));
+			dumpFrame = false;
 		}
 
-		// calculate delta time
-		elapsed = SDL_GetTicksNS() - startFrame;
-		game.delta = SDL_NS_TO_SECONDS(static_cast<float>(elapsed));
+		// end frame - framelimiting logic
+		profiler.end_frame();
+		pacer.wait();
 	}
 
 	//
 	// CLEANUP
 	//
+	if (profileCsvPath) profiler.dump_csv(profileCsvPath);
+	frameCapture.stop();
+	frameCapture.wait();
+
 	audio_close();
 	gfx.cleanup();
 	atlas.destroy();
 	SDL_DestroyWindow(game.window);
+	entityArena.dealloc();
+	if (replayPath) replayArena.dealloc();
+	frameArenas[0].dealloc();
+	frameArenas[1].dealloc();
 	GameContext::cleanup();
 	mems::close();
 	SDL_Quit();